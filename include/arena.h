@@ -0,0 +1,129 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ARENA_ALIGNMENT 64
+#define ARENA_DEFAULT_SIZE (1 << 20)
+
+/* Bump allocator for temporary buffers: memory is taken by moving a cursor
+ * forward and given back all at once by restoring a previous cursor */
+typedef struct {
+  char *base;
+  size_t size;
+  size_t used;
+} arena_t;
+
+/* Allocation counters of the calling thread (the grid memory of the workers
+ * of a parallel search is added to the thread that runs the search) */
+typedef struct {
+  size_t heap_allocs; /* buffers obtained from the heap (grids and arenas) */
+  size_t heap_frees;  /* buffers given back to the heap */
+  size_t pool_hits;   /* grids recycled from the grid pool */
+  size_t arena_peak;  /* highest arena usage (in bytes) */
+  size_t grid_bytes;  /* memory of the grids in use (in bytes) */
+  size_t grid_peak;   /* highest memory of the grids in use (in bytes) */
+} alloc_stats_t;
+
+/* Grid memory of threads that give back each other's grids (the workers of a
+ * parallel search), counted together since a thread alone cannot tell how
+ * much is in use */
+typedef struct {
+  atomic_long bytes; /* memory taken minus memory given back (in bytes) */
+  atomic_long peak;  /* highest value of 'bytes' */
+} alloc_group_t;
+
+/* Functions prototypes */
+
+/**
+@brief: allocates an aligned buffer from the arena, the arena grows when it
+            is empty and too small
+@param: arena_t *arena, const size_t bytes
+@return: void * (NULL if the arena is in use and too small)
+**/
+void *arena_alloc(arena_t *arena, const size_t bytes);
+
+/**
+@brief: returns the current cursor of the arena
+@param: const arena_t *arena
+@return: size_t
+**/
+size_t arena_save(const arena_t *arena);
+
+/**
+@brief: gives back every buffer allocated since the cursor was saved
+@param: arena_t *arena, const size_t cursor
+@return: void
+**/
+void arena_restore(arena_t *arena, const size_t cursor);
+
+/**
+@brief: frees the memory of the arena
+@param: arena_t *arena
+@return: void
+**/
+void arena_release(arena_t *arena);
+
+/**
+@brief: records heap allocations (positive) or frees (negative)
+@param: const int count
+@return: void
+**/
+void alloc_stats_heap(const int count);
+
+/**
+@brief: records memory of grids taken into use (positive) or given back
+            (negative). A grid given back by another thread than the one
+            that took it never brings the count below zero
+@param: const long bytes
+@return: void
+**/
+void alloc_stats_grid(const long bytes);
+
+/**
+@brief: records a grid taken from the grid pool instead of the heap
+@param: void
+@return: void
+**/
+void alloc_stats_pool_hit(void);
+
+/**
+@brief: starts a group with no memory counted
+@param: alloc_group_t *group
+@return: void
+**/
+void alloc_group_init(alloc_group_t *group);
+
+/**
+@brief: counts the grid memory of the calling thread in the group instead of
+            in its own counters, until it joins NULL
+@param: alloc_group_t *group
+@return: void
+**/
+void alloc_group_join(alloc_group_t *group);
+
+/**
+@brief: adds the grid memory of the group to the counters of the calling
+            thread, as if it had taken and given back the grids itself
+@param: const alloc_group_t *group
+@return: void
+**/
+void alloc_group_merge(const alloc_group_t *group);
+
+/**
+@brief: returns the allocation counters of the calling thread
+@param: void
+@return: alloc_stats_t
+**/
+alloc_stats_t alloc_stats_get(void);
+
+/**
+@brief: resets the allocation counters of the calling thread
+@param: void
+@return: void
+**/
+void alloc_stats_reset(void);
+
+#endif /* ARENA_H */
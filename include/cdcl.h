@@ -0,0 +1,73 @@
+#ifndef CDCL_H
+#define CDCL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "grid.h"
+
+/* Conflict-driven search with clause learning. Each candidate (cell, color)
+ * of the grid is a boolean variable and every cell, and every color of every
+ * unit, holds exactly one true variable. Assigning a variable to true
+ * removes the color from the peers (at-most-one propagation) and groups left
+ * with a single candidate are forced (watched literals). Conflicts are
+ * analysed down to the first unique implication point, the learned nogood
+ * is added to the clause database and the search backjumps
+ * non-chronologically. The search restarts following the Luby sequence. */
+typedef struct _cdcl_t cdcl_t;
+
+/* Called on each solution found, returning false stops the search */
+typedef bool (*cdcl_solution_t)(const grid_t *solution, void *data);
+
+typedef struct {
+  size_t decisions;
+  size_t propagations;
+  size_t conflicts;
+  size_t learned;   /* learned clauses (blocking clauses excluded) */
+  size_t deleted;   /* learned clauses removed by database reductions */
+  size_t restarts;
+  size_t max_level; /* deepest decision level reached */
+} cdcl_stats_t;
+
+/* Functions prototypes */
+
+/**
+@brief: builds the solver state from the candidates left in the grid
+@param: const grid_t *grid
+@return: cdcl_t * (NULL if the grid is NULL or the allocation failed)
+**/
+cdcl_t *cdcl_alloc(const grid_t *grid);
+
+/**
+@brief: frees the solver state
+@param: cdcl_t *cdcl
+@return: void
+**/
+void cdcl_free(cdcl_t *cdcl);
+
+/**
+@brief: searches the solutions, calling 'on_solution' on each of them. Once
+            a solution is found, a clause blocking it is added and the search
+            goes on until 'on_solution' returns false or no solution is left
+@param: cdcl_t *cdcl, cdcl_solution_t on_solution, void *data
+@return: size_t (number of solutions found, see cdcl_failed)
+**/
+size_t cdcl_search(cdcl_t *cdcl, cdcl_solution_t on_solution, void *data);
+
+/**
+@brief: tells whether the search stopped because a clause couldn't be
+            stored or watched (out of memory): its solutions are then
+            incomplete
+@param: const cdcl_t *cdcl
+@return: bool
+**/
+bool cdcl_failed(const cdcl_t *cdcl);
+
+/**
+@brief: returns the search statistics
+@param: const cdcl_t *cdcl
+@return: cdcl_stats_t
+**/
+cdcl_stats_t cdcl_stats(const cdcl_t *cdcl);
+
+#endif /* CDCL_H */
@@ -10,137 +10,269 @@
 
 typedef uint64_t colors_t;
 
-/* Functions prototypes */
+/* Bitwise functions, inlined: most of them are a single instruction. With
+ * GCC or Clang, the bit scans use the builtins (tzcnt/lzcnt or bsf/bsr) and
+ * the population count uses popcnt when the target has it. Without popcnt,
+ * or with another compiler, the count is done in SWAR and the bit scans are
+ * derived from it. */
 
 /**
 @brief: checks if two colors are equal
 @param: const colors_t colors1, const colors_t colors2
 @return: bool
 **/
-bool colors_is_equal(const colors_t colors1, const colors_t colors2);
+static inline bool colors_is_equal(const colors_t colors1,
+                                   const colors_t colors2) {
+  return colors1 == colors2;
+}
+
+/**
+@brief:  sets a color at position color_id
+@param: const size_t color_id
+@return: colors_t
+**/
+static inline colors_t colors_set(const size_t color_id) {
+  if (color_id >= MAX_COLORS) {
+    return 0ULL;
+  }
+  return 1ULL << color_id;
+}
 
 /**
 @brief: checks if the bit at colors index in colors is set
 @param: const colors_t colors, const size_t colors_id
 @return: bool
 **/
-bool colors_is_in(const colors_t colors, const size_t colors_id);
+static inline bool colors_is_in(const colors_t colors, const size_t color_id) {
+  return (colors & colors_set(color_id)) != 0ULL;
+}
 
 /**
 @brief: checks if there's only one bit set
 @param: const colors_t colors
 @return: bool
 **/
-bool colors_is_singleton(const colors_t colors);
+static inline bool colors_is_singleton(const colors_t colors) {
+  return (colors != 0) && ((colors & (colors - 1)) == 0);
+}
 
 /**
 @brief: checks if colors1 is a subset of colors2
 @param: const colors_t colors1, const colors_t colors2
 @return: bool
 **/
-bool colors_is_subset(const colors_t colors1, const colors_t colors2);
+static inline bool colors_is_subset(const colors_t colors1,
+                                    const colors_t colors2) {
+  return (colors1 & colors2) == colors1;
+}
 
 /**
 @brief: sets the bit at position colors_id
 @param: const colors_t colors, const size_t colors_id
 @return: colors_t
 **/
-colors_t colors_add(const colors_t colors, const size_t colors_id);
+static inline colors_t colors_add(const colors_t colors,
+                                  const size_t color_id) {
+  return colors | colors_set(color_id);
+}
 
 /**
 @brief: sets bits if they are both set
 @param: const colors_t colors1, const colors_t colors2
 @return: colors_t
 **/
-colors_t colors_and(const colors_t colors1, const colors_t colors2);
+static inline colors_t colors_and(const colors_t colors1,
+                                  const colors_t colors2) {
+  return colors1 & colors2;
+}
 
 /**
 @brief: discard a color from an existing colors_t
 @param: const colors_t colors, const size_t colors_id
 @return: colors_t
 **/
-colors_t colors_discard(const colors_t colors, const size_t colors_id);
+static inline colors_t colors_discard(const colors_t colors,
+                                      const size_t color_id) {
+  return colors & ~(colors_set(color_id));
+}
 
 /**
 @brief: return 0
 @param: void
 @return: 0ULL
 **/
-colors_t colors_empty(void);
+static inline colors_t colors_empty(void) {
+  return 0ULL;
+}
 
 /**
 @brief: sets all bits
 @param:  size_t size
 @return: colors_t
 **/
-colors_t colors_full(const size_t size);
+static inline colors_t colors_full(const size_t size) {
+  if (size >= MAX_COLORS) {
+    return ~0ULL;
+  }
+  return (1ULL << size) - 1ULL;
+}
+
+/**
+@brief: returns the number of colors enclosed in the set
+@param: const colors_t colors
+@return: size_t
+**/
+static inline size_t colors_count(const colors_t colors) {
+#if defined(__GNUC__) && defined(__POPCNT__)
+  return (size_t)__builtin_popcountll(colors);
+#else
+  /* Without popcnt the builtin is a library call, SWAR is faster */
+  colors_t count = colors - ((colors >> 1) & 0x5555555555555555ULL);
+  count = (count & 0x3333333333333333ULL) +
+          ((count >> 2) & 0x3333333333333333ULL);
+  count = (count + (count >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+  return (size_t)((count * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/**
+@brief: returns the index of the rightmost bit (colors must not be empty)
+@param: const colors_t colors
+@return: size_t
+**/
+static inline size_t colors_index(const colors_t colors) {
+#ifdef __GNUC__
+  return (size_t)__builtin_ctzll(colors);
+#else
+  return colors_count((colors & -colors) - 1);
+#endif
+}
+
+/**
+@brief: returns the index of the leftmost bit (colors must not be empty)
+@param: const colors_t colors
+@return: size_t
+**/
+static inline size_t colors_last_index(const colors_t colors) {
+#ifdef __GNUC__
+  return (size_t)(MAX_COLORS - 1 - __builtin_clzll(colors));
+#else
+  /* Every bit right of the leftmost one set, then counted */
+  colors_t smear = colors | (colors >> 1);
+  smear |= smear >> 2;
+  smear |= smear >> 4;
+  smear |= smear >> 8;
+  smear |= smear >> 16;
+  smear |= smear >> 32;
+  return colors_count(smear) - 1;
+#endif
+}
 
 /**
 @brief: returns the leftmost bit
 @param:  const colors_t colors
 @return: colors_t
 **/
-colors_t colors_leftmost(const colors_t colors);
+static inline colors_t colors_leftmost(const colors_t colors) {
+  if (colors == 0) {
+    return 0ULL;
+  }
+  return 1ULL << colors_last_index(colors);
+}
 
 /**
 @brief: negates all bits
 @param: const colors_t colors
 @return: colors_t
 **/
-colors_t colors_negate(const colors_t colors);
+static inline colors_t colors_negate(const colors_t colors) {
+  return ~colors;
+}
 
 /**
 @brief: return bits if they are either set in colors1 or colors2
 @param: const colors_t colors1, const colors_t colors2
 @return: colors_t
 **/
-colors_t colors_or(const colors_t colors1, const colors_t colors2);
-
-/* Here we suppose that the seed has already been initialized in the main */
-/**
-@brief: return a 'randomized' color
-@param: const colors_t colors
-@return: colors_t
-**/
-colors_t colors_random(const colors_t colors);
+static inline colors_t colors_or(const colors_t colors1,
+                                 const colors_t colors2) {
+  return colors1 | colors2;
+}
 
 /**
 @brief: returns rightmost bit
 @param: const colors_t colors
 @return: colors_t
 **/
-colors_t colors_rightmost(const colors_t colors);
+static inline colors_t colors_rightmost(const colors_t colors) {
+  return colors & -colors;
+}
 
 /**
-@brief:  sets a color at position color_id
-@param: const size_t color_id
-@return: colors_t
+@brief: removes the rightmost bit and returns its index, to iterate over
+            the colors of a set (colors must not be empty)
+@param: colors_t *colors
+@return: size_t
 **/
-colors_t colors_set(const size_t color_id);
+static inline size_t colors_pop(colors_t *colors) {
+  size_t index = colors_index(*colors);
+  *colors &= *colors - 1;
+  return index;
+}
 
 /**
 @brief: subtraction between two colors_t
 @param: const colors_t colors1, const colors_t colors2
 @return: colors_t
 **/
-colors_t colors_subtract(const colors_t colors1, const colors_t colors2);
+static inline colors_t colors_subtract(const colors_t colors1,
+                                       const colors_t colors2) {
+  return colors1 & ~colors2;
+}
 
 /**
 @brief: exclusive union of two colors
 @param: const colors_t colors1, const colors_t colors
 @return: colors_t
 **/
-colors_t colors_xor(const colors_t colors1, const colors_t colors2);
+static inline colors_t colors_xor(const colors_t colors1,
+                                  const colors_t colors2) {
+  return colors1 ^ colors2;
+}
 
 /**
-@brief: returns the number of colors enclosed in the set
+@brief: returns the color of rank 'rank' (from the right) of the set, or
+            no color if the set is smaller
+@param: const colors_t colors, const size_t rank
+@return: colors_t
+**/
+static inline colors_t colors_select(const colors_t colors,
+                                     const size_t rank) {
+  colors_t copy = colors;
+  for (size_t index = 0; index < rank && copy != 0; index++) {
+    copy &= copy - 1;
+  }
+  return colors_rightmost(copy);
+}
+
+/* Functions prototypes */
+
+/* Here we suppose that the seed has already been initialized in the main */
+/**
+@brief: return a 'randomized' color
 @param: const colors_t colors
-@return: size_t
+@return: colors_t
 **/
-size_t colors_count(const colors_t colors);
+colors_t colors_random(const colors_t colors);
 
 /* Heuristics and subgrid functions */
 
+#define SUBSET_DEFAULT_ORDER 4 /* largest naked/hidden subsets looked for */
+
+/* Grid sizes with specialized instances of subgrid_singles and
+ * subgrid_subsets */
+#define SUBGRID_SIZES(X) X(1) X(4) X(9) X(16) X(25) X(36) X(49) X(64)
+
 /**
 @brief: applies cross hatching heuristic to given sudoku subgrid
 @param: colors_t *subgrid[], const size_t size
@@ -156,14 +288,27 @@ bool cross_hatching_heuristic(colors_t *subgrid[], size_t size);
 bool lone_number_heuristic(colors_t *subgrid[], size_t size);
 
 /**
-@brief: applies naked heuristic to a given sudoku subgrid
+@brief: sets the size of the largest naked and hidden subsets looked for
+            (between 2 and 32). It is a process-wide setting, to be changed
+            before any search starts
+@param: const size_t max_order
+@return: void
+**/
+void subgrid_subset_limit(const size_t max_order);
+
+/**
+@brief: applies naked subset heuristic to a given sudoku subgrid: k cells
+            holding k colors between them remove these colors from the
+            other cells (k up to the subset limit)
 @param: colors_t *subgrid[], const size_t size
 @return: bool
 **/
 bool naked_subset_heuristic(colors_t *subgrid[], size_t size);
 
 /**
-@brief: applies hidden subset heuristic to given sudoku subgrid
+@brief: applies hidden subset heuristic to given sudoku subgrid: k colors
+            found in k cells only remove the other colors from these cells
+            (k up to the subset limit)
 @param: colors_t *subgrid[], const size_t size
 @return: bool
 **/
@@ -177,7 +322,24 @@ bool hidden_subset_heuristic(colors_t *subgrid[], size_t size);
 bool subgrid_consistency(colors_t subgrid[], const size_t size);
 
 /**
-@brief: applies heuristics to given sudoku subgrid
+@brief: applies the cross hatching and lone number heuristics to given
+            sudoku subgrid until they change nothing
+@param: colors_t *subgrid[], const size_t size
+@return: bool
+**/
+bool subgrid_singles(colors_t *subgrid[], size_t size);
+
+/**
+@brief: applies the naked and hidden subset heuristics to given sudoku
+            subgrid until they change nothing
+@param: colors_t *subgrid[], const size_t size
+@return: bool
+**/
+bool subgrid_subsets(colors_t *subgrid[], size_t size);
+
+/**
+@brief: applies heuristics to given sudoku subgrid (subgrid_singles, then
+            subgrid_subsets)
 @param: colors_t *subgrid[], const size_t size
 @return: bool
 **/
@@ -0,0 +1,56 @@
+#ifndef DLX_H
+#define DLX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "grid.h"
+
+/* Exact cover matrix of a grid solved with Dancing Links (Algorithm X).
+ * Each remaining candidate (cell, color) of the grid is a row covering
+ * four columns: the cell, the color in the row, in the column and in the
+ * block. Nodes live in one index-based array (no pointer per node). */
+typedef struct _dlx_t dlx_t;
+
+/* Called on each solution found, returning false stops the search */
+typedef bool (*dlx_solution_t)(const grid_t *solution, void *data);
+
+typedef struct {
+  size_t nodes;      /* rows tried */
+  size_t dead_ends;  /* columns found with no row left */
+  size_t max_level;  /* deepest level reached */
+} dlx_stats_t;
+
+/* Functions prototypes */
+
+/**
+@brief: builds the exact cover matrix of the candidates left in the grid
+@param: const grid_t *grid
+@return: dlx_t * (NULL if the grid is NULL or the allocation failed)
+**/
+dlx_t *dlx_alloc(const grid_t *grid);
+
+/**
+@brief: frees the exact cover matrix
+@param: dlx_t *dlx
+@return: void
+**/
+void dlx_free(dlx_t *dlx);
+
+/**
+@brief: enumerates the solutions, smallest column first, calling
+            'on_solution' on each of them (solutions are only built when
+            'on_solution' is not NULL)
+@param: dlx_t *dlx, dlx_solution_t on_solution, void *data
+@return: size_t (number of solutions found)
+**/
+size_t dlx_search(dlx_t *dlx, dlx_solution_t on_solution, void *data);
+
+/**
+@brief: returns the search statistics
+@param: const dlx_t *dlx
+@return: dlx_stats_t
+**/
+dlx_stats_t dlx_stats(const dlx_t *dlx);
+
+#endif /* DLX_H */
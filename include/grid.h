@@ -3,6 +3,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -10,6 +11,7 @@
 
 #define EMPTY_CELL '_'
 #define MAX_GRID_SIZE 64
+#define GRID_UNIT_TYPES 3 /* rows, columns and blocks */
 
 static const char color_table[] = "123456789"
                                   "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -27,8 +29,87 @@ typedef struct {
   colors_t color;
 } choice_t;
 
+/* Order in which the colors of the branching cell are tried */
+typedef enum {
+  value_lowest,             /* lowest color first */
+  value_least_constraining, /* color found in the fewest peers first */
+  value_most_frequent,      /* color fixed the most in the rows of the band
+                             * and the columns of the stack first */
+  value_random              /* uniform, from a caller-owned random state */
+} value_order_t;
+
+/* Tie-break among the unsolved cells with the fewest colors */
+typedef enum {
+  tie_fewest_unsolved, /* fewest unsolved cells in its units (default) */
+  tie_most_unsolved    /* most unsolved cells in its units (degree) */
+} tie_break_t;
+
 typedef struct _grid_t grid_t;
 
+#define GRID_FISH_MAX_ORDER 4 /* jellyfish */
+
+/* Fish statistics of the calling thread */
+typedef struct {
+  size_t calls;        /* fish stages run */
+  size_t combinations; /* sets of lines enumerated */
+  size_t found[GRID_FISH_MAX_ORDER + 1]; /* patterns with eliminations, per
+                                          * order (2: x-wing, 3: swordfish) */
+  size_t eliminations; /* colors removed */
+  size_t exhausted;    /* stages stopped by the enumeration budget */
+} fish_stats_t;
+
+/* Stages of grid_heuristics, cheapest first in the default pipeline */
+typedef enum {
+  heuristic_singles, /* peers of fixed cells, cross-hatching, lone number */
+  heuristic_locked,  /* locked candidates (pointing and claiming) */
+  heuristic_subsets, /* naked and hidden subsets */
+  heuristic_fish     /* x-wing, swordfish, jellyfish (see grid_fish_enable) */
+} heuristic_t;
+
+#define GRID_HEURISTICS_NB 4
+
+/* Scheduler statistics of a stage, for the calling thread */
+typedef struct {
+  size_t runs;          /* times the stage ran */
+  size_t skips;         /* calls of grid_heuristics it sat out */
+  size_t backoffs;      /* calls after which it was put on hold */
+  size_t eliminations;  /* colors removed while it ran */
+  uint64_t nanoseconds; /* time spent running */
+} heuristic_stats_t;
+
+/* Unit and peer tables shared by all the grids of a given size. Cells are
+ * referred to by their row-major index (row * size + column). Units are
+ * stored rows first, then columns, then blocks. */
+typedef struct {
+  size_t size;
+  size_t block_size;
+  size_t units_nb;      /* GRID_UNIT_TYPES * size */
+  size_t peers_nb;      /* number of peers of any cell */
+  uint16_t *units;      /* units_nb x size cell indices */
+  uint16_t *peers;      /* (size * size) x peers_nb cell indices */
+  uint16_t *cell_units; /* (size * size) x GRID_UNIT_TYPES unit ids */
+} grid_tables_t;
+
+/**
+@brief: returns the cell indices of the given unit
+@param: const grid_tables_t *tables, const size_t unit
+@return: const uint16_t *
+**/
+static inline const uint16_t *grid_tables_unit(const grid_tables_t *tables,
+                                               const size_t unit) {
+  return &tables->units[unit * tables->size];
+}
+
+/**
+@brief: returns the peer cell indices of the given cell
+@param: const grid_tables_t *tables, const size_t cell
+@return: const uint16_t *
+**/
+static inline const uint16_t *grid_tables_peers(const grid_tables_t *tables,
+                                                const size_t cell) {
+  return &tables->peers[cell * tables->peers_nb];
+}
+
 /* Functions prototypes */
 
 /**
@@ -75,6 +156,13 @@ bool grid_is_solved(grid_t *grid);
 bool subgrid_apply(grid_t *grid,
                    bool (*func)(colors_t *subgrid[], const size_t size));
 
+/**
+@brief: gets the unit and peer tables of a grid size (built on first use)
+@param: const size_t size
+@return: const grid_tables_t * (NULL if the size is not supported)
+**/
+const grid_tables_t *grid_tables(const size_t size);
+
 /**
 @brief: allocates memory for the grid
 @param: size_t size
@@ -97,12 +185,20 @@ grid_t *grid_copy(const grid_t *grid);
 size_t grid_get_size(const grid_t *grid);
 
 /**
-@brief: frees allocated memory of the grid
+@brief: gives the grid back to the grid pool of its size, its memory is
+            reused by the next grid_alloc of the same size in this thread
 @param: grid_t *grid
 @return: void
 **/
 void grid_free(grid_t *grid);
 
+/**
+@brief: frees the memory of every grid in the grid pool of this thread
+@param: void
+@return: void
+**/
+void grid_pool_release(void);
+
 /**
 @brief: displays the grid into the file
 @param: const grid_t *grid, FILE *fd
@@ -120,22 +216,170 @@ void grid_set_cell(grid_t *grid, const size_t row, const size_t column,
                    const char color);
 
 /**
-@brief: returns the grid status
+@brief: runs the heuristics on the dirty units only, until no unit is left
+            dirty, and removes newly fixed colors from their peers
+@param: grid_t *grid
+@return: status_t (grid_inconsistent if a cell runs out of colors,
+            grid_unsolved otherwise, the grid is not fully checked)
+**/
+status_t grid_propagate(grid_t *grid);
+
+/**
+@brief: enables the fish stage of grid_heuristics (x-wing, swordfish,
+            jellyfish) up to the given order, 0 disables it (default). It is
+            a process-wide setting, to be changed before any search starts
+@param: const size_t max_order
+@return: void
+**/
+void grid_fish_enable(const size_t max_order);
+
+/**
+@brief: returns the fish statistics of the calling thread
+@param: void
+@return: fish_stats_t
+**/
+fish_stats_t grid_fish_stats(void);
+
+/**
+@brief: adds fish statistics (gathered by another thread) to the fish
+            statistics of the calling thread
+@param: const fish_stats_t stats
+@return: void
+**/
+void grid_fish_stats_add(const fish_stats_t stats);
+
+/**
+@brief: resets the fish statistics of the calling thread
+@param: void
+@return: void
+**/
+void grid_fish_stats_reset(void);
+
+/**
+@brief: sets the stages run by grid_heuristics, in order. The pipeline has to
+            start with heuristic_singles and holds each stage at most once. In
+            adaptive mode, a stage costlier than the singles that removes
+            nothing during a call is skipped on the next calls, twice as many
+            each time it stays dry.
+            Default: singles, locked, subsets, fish, not adaptive. It is a
+            process-wide setting, to be changed before any search starts
+@param: const heuristic_t stages[], const size_t stages_nb,
+            const bool adaptive
+@return: bool (false if the pipeline is invalid, the previous one is kept)
+**/
+bool grid_pipeline_set(const heuristic_t stages[], const size_t stages_nb,
+                       const bool adaptive);
+
+/**
+@brief: copies the stages of the pipeline into 'stages'
+@param: heuristic_t stages[GRID_HEURISTICS_NB]
+@return: size_t (number of stages)
+**/
+size_t grid_pipeline_get(heuristic_t stages[GRID_HEURISTICS_NB]);
+
+/**
+@brief: tells whether the pipeline backs off the stages with no yield
+@param: void
+@return: bool
+**/
+bool grid_pipeline_is_adaptive(void);
+
+/**
+@brief: returns the name of a stage ("singles", "locked", "subsets", "fish")
+@param: const heuristic_t heuristic
+@return: const char * (NULL if the stage is unknown)
+**/
+const char *grid_heuristic_name(const heuristic_t heuristic);
+
+/**
+@brief: returns the scheduler statistics of a stage for the calling thread
+@param: const heuristic_t heuristic
+@return: heuristic_stats_t
+**/
+heuristic_stats_t grid_heuristic_stats(const heuristic_t heuristic);
+
+/**
+@brief: adds statistics of a stage (gathered by another thread) to the
+            statistics of the calling thread
+@param: const heuristic_t heuristic, const heuristic_stats_t stats
+@return: void
+**/
+void grid_heuristic_stats_add(const heuristic_t heuristic,
+                              const heuristic_stats_t stats);
+
+/**
+@brief: resets the scheduler statistics and back-off state of the calling
+            thread
+@param: void
+@return: void
+**/
+void grid_heuristic_stats_reset(void);
+
+/**
+@brief: runs the stages of the pipeline until none of them changes the grid
+            (a stage removing a color sends the grid back to the first stage)
+            and returns the grid status
 @param: grid_t *grid
 @return: status_t
 **/
 status_t grid_heuristics(grid_t *grid);
 
+/* Trail functions (undo log used to backtrack in place) */
+
+/**
+@brief: starts (or restarts, from an empty trail) logging every cell
+            modification of the grid so that it can be undone with
+            grid_trail_restore (subgrid_apply is not logged)
+@param: grid_t *grid
+@return: bool (false if the trail could not be allocated)
+**/
+bool grid_trail_enable(grid_t *grid);
+
+/**
+@brief: returns a restore point for the current state of the grid
+@param: const grid_t *grid
+@return: size_t
+**/
+size_t grid_trail_save(const grid_t *grid);
+
+/**
+@brief: undoes every cell modification made since the restore point, gives
+            the units back the subsets flags they had then and drops the
+            pending propagation events
+@param: grid_t *grid, const size_t point
+@return: void
+**/
+void grid_trail_restore(grid_t *grid, const size_t point);
+
 /* Choice functions */
 
 /**
-@brief: chooses the smallest set of colors of the grid and selects the rightmost
-            color
+@brief: sets the tie-break of grid_choice among the first cells with the
+            fewest colors. It is a process-wide setting, to be changed before
+            any search starts
+@param: const tie_break_t tie_break
+@return: void
+**/
+void grid_choice_tie_break(const tie_break_t tie_break);
+
+/**
+@brief: chooses an unsolved cell with the fewest colors (ties broken as set
+            by grid_choice_tie_break) and selects its rightmost color
 @param: grid_t *grid
 @return: choice_t
 **/
 choice_t grid_choice(grid_t *grid);
 
+/**
+@brief: chooses the same cell as grid_choice and selects its color following
+            'order'. 'state' is the random state of value_random (seeded by
+            the caller, updated on each call)
+@param: grid_t *grid, const value_order_t order, uint64_t *state
+@return: choice_t
+**/
+choice_t grid_choice_ordered(grid_t *grid, const value_order_t order,
+                             uint64_t *state);
+
 /**
 @brief: checks if a choice is empty
 @param: const choice_t choice
@@ -168,9 +412,9 @@ void grid_choice_print(const choice_t choice, FILE *fd);
 
 /**
 @brief: returns a cell color
-@param: grid_t *grid, size_t row, size_t col
+@param: const grid_t *grid, size_t row, size_t col
 @return: colors_t
 **/
-colors_t get_grid_color(grid_t *grid, size_t row, size_t col);
+colors_t get_grid_color(const grid_t *grid, size_t row, size_t col);
 
 #endif /* GRID_H */
\ No newline at end of file
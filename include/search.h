@@ -0,0 +1,89 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "grid.h"
+
+#define SEARCH_MAX_THREADS 256
+
+/* Called on each solution found (one call at a time, even with several
+ * threads), returning false stops the search */
+typedef bool (*search_solution_t)(const grid_t *solution, void *data);
+
+/* Answer of a uniqueness query */
+typedef enum {
+  solutions_none,
+  solutions_unique,
+  solutions_many /* at least two */
+} uniqueness_t;
+
+/* Statistics of a search, all threads together */
+typedef struct {
+  size_t nodes;      /* grids propagated (one per choice, plus the root) */
+  size_t backtracks; /* choices undone after a dead end or a solution */
+  size_t max_depth;  /* deepest choice stack of a task */
+  uint64_t worker_cpu_ns; /* CPU time of the threads started by the search */
+} search_stats_t;
+
+/* Backtracking search configuration. The search only depends on it (no
+ * global state), so that several searches can run concurrently. */
+typedef struct {
+  size_t threads;  /* worker threads, 1 for a sequential search */
+  bool verbose;    /* print every choice on 'fd' */
+  FILE *fd;
+  search_solution_t on_solution; /* NULL to only count the solutions */
+  void *data;
+  value_order_t order; /* order of the colors tried at each choice */
+  uint64_t seed;       /* seed of value_random (one stream per thread) */
+  search_stats_t *stats; /* NULL, or filled at the end of the search (the
+                          * heuristic statistics of the workers are added to
+                          * those of the calling thread) */
+} search_t;
+
+/* Functions prototypes */
+
+/**
+@brief: explores the grid with heuristics and backtracking, in place (the
+            grid is consumed). With several threads, the search tree is split
+            at choice points into tasks shared through work-stealing deques
+@param: grid_t *grid, const search_t *search
+@return: size_t (number of solutions found)
+**/
+size_t search_run(grid_t *grid, const search_t *search);
+
+/**
+@brief: counts the solutions of a grid up to 'limit', stopping the search as
+            soon as it is reached. The grid is left untouched: the search runs
+            in place on a copy, undoing its choices with the trail of the copy
+@param: const grid_t *grid, const size_t threads, const size_t limit,
+            search_stats_t *stats (NULL, or filled as by search_run)
+@return: size_t (number of solutions found, at most 'limit')
+**/
+size_t search_count(const grid_t *grid, const size_t threads,
+                    const size_t limit, search_stats_t *stats);
+
+/**
+@brief: tells whether a grid has no solution, a unique one or several,
+            stopping the search at the second solution. The grid is left
+            untouched: the search runs in place on a copy, undoing its
+            choices with the trail of the copy
+@param: const grid_t *grid, const size_t threads, grid_t **solution (NULL, or
+            set to a copy of the solution when it is unique, NULL otherwise),
+            search_stats_t *stats (NULL, or filled as by search_run)
+@return: uniqueness_t
+**/
+uniqueness_t search_unique(const grid_t *grid, const size_t threads,
+                           grid_t **solution, search_stats_t *stats);
+
+/**
+@brief: frees the temporary buffers of the searches run by this thread
+@param: void
+@return: void
+**/
+void search_release(void);
+
+#endif /* SEARCH_H */
@@ -0,0 +1,136 @@
+#include "arena.h"
+
+#include <stdlib.h>
+
+static _Thread_local alloc_stats_t alloc_stats;
+static _Thread_local alloc_group_t *alloc_group; /* NULL out of a group */
+
+/* Arena functions */
+
+void *arena_alloc(arena_t *arena, const size_t bytes) {
+  if (arena == NULL) {
+    return NULL;
+  }
+
+  size_t rounded = (bytes + ARENA_ALIGNMENT - 1) & ~((size_t)ARENA_ALIGNMENT - 1);
+  if (arena->used + rounded > arena->size) {
+    if (arena->used > 0) {
+      return NULL;
+    }
+
+    /* Nothing lives in the arena yet: it can be replaced by a bigger one */
+    size_t size = arena->size > 0 ? arena->size : ARENA_DEFAULT_SIZE;
+    while (size < rounded) {
+      size *= 2;
+    }
+    char *base = aligned_alloc(ARENA_ALIGNMENT, size);
+    if (base == NULL) {
+      return NULL;
+    }
+    arena_release(arena);
+    alloc_stats_heap(1);
+    arena->base = base;
+    arena->size = size;
+  }
+
+  void *buffer = arena->base + arena->used;
+  arena->used += rounded;
+  if (arena->used > alloc_stats.arena_peak) {
+    alloc_stats.arena_peak = arena->used;
+  }
+  return buffer;
+}
+
+size_t arena_save(const arena_t *arena) {
+  if (arena == NULL) {
+    return 0;
+  }
+  return arena->used;
+}
+
+void arena_restore(arena_t *arena, const size_t cursor) {
+  if (arena == NULL || cursor > arena->used) {
+    return;
+  }
+  arena->used = cursor;
+}
+
+void arena_release(arena_t *arena) {
+  if (arena == NULL) {
+    return;
+  }
+  if (arena->base != NULL) {
+    free(arena->base);
+    alloc_stats_heap(-1);
+  }
+  arena->base = NULL;
+  arena->size = 0;
+  arena->used = 0;
+}
+
+/* Allocation counters */
+
+void alloc_stats_heap(const int count) {
+  if (count > 0) {
+    alloc_stats.heap_allocs += count;
+  } else {
+    alloc_stats.heap_frees += -count;
+  }
+}
+
+void alloc_stats_grid(const long bytes) {
+  if (alloc_group != NULL) {
+    long now = atomic_fetch_add_explicit(&alloc_group->bytes, bytes,
+                                         memory_order_relaxed) +
+               bytes;
+    long peak = atomic_load_explicit(&alloc_group->peak, memory_order_relaxed);
+    while (now > peak && !atomic_compare_exchange_weak_explicit(
+                             &alloc_group->peak, &peak, now,
+                             memory_order_relaxed, memory_order_relaxed)) {
+    }
+    return;
+  }
+
+  if (bytes >= 0) {
+    alloc_stats.grid_bytes += bytes;
+    if (alloc_stats.grid_bytes > alloc_stats.grid_peak) {
+      alloc_stats.grid_peak = alloc_stats.grid_bytes;
+    }
+  } else if ((size_t)-bytes < alloc_stats.grid_bytes) {
+    alloc_stats.grid_bytes -= (size_t)-bytes;
+  } else {
+    alloc_stats.grid_bytes = 0;
+  }
+}
+
+void alloc_stats_pool_hit(void) {
+  alloc_stats.pool_hits++;
+}
+
+alloc_stats_t alloc_stats_get(void) {
+  return alloc_stats;
+}
+
+void alloc_stats_reset(void) {
+  alloc_stats_t empty = {0, 0, 0, 0, 0, 0};
+  alloc_stats = empty;
+}
+
+/* Grid memory groups */
+
+void alloc_group_init(alloc_group_t *group) {
+  atomic_init(&group->bytes, 0);
+  atomic_init(&group->peak, 0);
+}
+
+void alloc_group_join(alloc_group_t *group) {
+  alloc_group = group;
+}
+
+void alloc_group_merge(const alloc_group_t *group) {
+  long peak = (long)alloc_stats.grid_bytes + atomic_load(&group->peak);
+  if (peak > 0 && (size_t)peak > alloc_stats.grid_peak) {
+    alloc_stats.grid_peak = (size_t)peak;
+  }
+  alloc_stats_grid(atomic_load(&group->bytes));
+}
@@ -0,0 +1,786 @@
+#include "cdcl.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#define VALUE_FALSE 0
+#define VALUE_TRUE 1
+#define VALUE_UNDEF 2
+
+#define REASON_NONE UINT32_MAX
+#define REASON_BINARY 0x80000000U /* 'var -> not y', low bits hold var */
+#define NOT_IN_HEAP UINT32_MAX
+
+#define RESTART_BASE 100
+#define ACTIVITY_DECAY 0.95
+#define ACTIVITY_LIMIT 1e100
+#define LEARNED_LIMIT_MIN 4000
+#define LEARNED_LIMIT_GROWTH 1.1
+
+/* Literals: variable (cell * size + color) shifted left, low bit set when
+ * the literal is negated */
+typedef uint32_t lit_t;
+
+typedef enum { clause_group, clause_learned, clause_blocking } clause_kind_t;
+
+typedef struct {
+  uint32_t start; /* first literal in the literal pool */
+  uint32_t size;
+  uint8_t kind;
+} clause_t;
+
+typedef struct {
+  uint32_t *clauses;
+  uint32_t nb;
+  uint32_t capacity;
+} watch_list_t;
+
+struct _cdcl_t {
+  size_t size;
+  size_t vars_nb;
+  const grid_tables_t *tables;
+  grid_t *grid; /* grid the solver was built from */
+
+  /* Assignment */
+  uint8_t *value;
+  uint32_t *level;
+  uint32_t *reason;
+  lit_t *trail;
+  size_t trail_nb;
+  size_t queue_head;
+  uint32_t *trail_lim; /* trail size at the start of every decision level */
+  size_t levels;
+  bool unsatisfiable;
+
+  /* Clause database */
+  lit_t *lits;
+  size_t lits_nb;
+  size_t lits_capacity;
+  bool failed; /* a clause couldn't be stored or watched: search stopped */
+  clause_t *clauses;
+  size_t clauses_nb;
+  size_t clauses_capacity;
+  size_t learned_nb;
+  size_t learned_limit;
+  watch_list_t *watches; /* clauses to visit when the literal becomes false */
+
+  /* Conflict */
+  uint32_t conflict;     /* conflicting clause, REASON_NONE if binary */
+  lit_t conflict_lits[2];
+  uint8_t *seen;
+  lit_t *learned;
+
+  /* Variable activity heap (VSIDS) */
+  double *activity;
+  double activity_inc;
+  uint32_t *heap;
+  uint32_t *heap_pos;
+  size_t heap_nb;
+
+  cdcl_stats_t stats;
+};
+
+/* Literal helpers */
+
+static inline lit_t lit_make(const uint32_t var, const bool negated) {
+  return (var << 1) | (negated ? 1 : 0);
+}
+
+static inline uint32_t lit_var(const lit_t lit) {
+  return lit >> 1;
+}
+
+static inline bool lit_negated(const lit_t lit) {
+  return lit & 1;
+}
+
+static inline lit_t lit_not(const lit_t lit) {
+  return lit ^ 1;
+}
+
+static inline uint8_t lit_value(const cdcl_t *cdcl, const lit_t lit) {
+  uint8_t value = cdcl->value[lit_var(lit)];
+  return value == VALUE_UNDEF ? VALUE_UNDEF : value ^ lit_negated(lit);
+}
+
+/* Activity heap */
+
+static inline bool heap_before(const cdcl_t *cdcl, const uint32_t var1,
+                               const uint32_t var2) {
+  return cdcl->activity[var1] > cdcl->activity[var2];
+}
+
+static void heap_place(cdcl_t *cdcl, size_t index, const uint32_t var) {
+  cdcl->heap[index] = var;
+  cdcl->heap_pos[var] = index;
+}
+
+static void heap_up(cdcl_t *cdcl, size_t index) {
+  uint32_t var = cdcl->heap[index];
+  while (index > 0 && heap_before(cdcl, var, cdcl->heap[(index - 1) / 2])) {
+    heap_place(cdcl, index, cdcl->heap[(index - 1) / 2]);
+    index = (index - 1) / 2;
+  }
+  heap_place(cdcl, index, var);
+}
+
+static void heap_down(cdcl_t *cdcl, size_t index) {
+  uint32_t var = cdcl->heap[index];
+  while (2 * index + 1 < cdcl->heap_nb) {
+    size_t child = 2 * index + 1;
+    if (child + 1 < cdcl->heap_nb &&
+        heap_before(cdcl, cdcl->heap[child + 1], cdcl->heap[child])) {
+      child++;
+    }
+    if (!heap_before(cdcl, cdcl->heap[child], var)) {
+      break;
+    }
+    heap_place(cdcl, index, cdcl->heap[child]);
+    index = child;
+  }
+  heap_place(cdcl, index, var);
+}
+
+static void heap_insert(cdcl_t *cdcl, const uint32_t var) {
+  if (cdcl->heap_pos[var] != NOT_IN_HEAP) {
+    return;
+  }
+  cdcl->heap_nb++;
+  heap_place(cdcl, cdcl->heap_nb - 1, var);
+  heap_up(cdcl, cdcl->heap_nb - 1);
+}
+
+static uint32_t heap_pop(cdcl_t *cdcl) {
+  uint32_t var = cdcl->heap[0];
+  cdcl->heap_pos[var] = NOT_IN_HEAP;
+  cdcl->heap_nb--;
+  if (cdcl->heap_nb > 0) {
+    heap_place(cdcl, 0, cdcl->heap[cdcl->heap_nb]);
+    heap_down(cdcl, 0);
+  }
+  return var;
+}
+
+static void activity_bump(cdcl_t *cdcl, const uint32_t var) {
+  cdcl->activity[var] += cdcl->activity_inc;
+  if (cdcl->activity[var] > ACTIVITY_LIMIT) {
+    for (size_t index = 0; index < cdcl->vars_nb; index++) {
+      cdcl->activity[index] /= ACTIVITY_LIMIT;
+    }
+    cdcl->activity_inc /= ACTIVITY_LIMIT;
+  }
+  if (cdcl->heap_pos[var] != NOT_IN_HEAP) {
+    heap_up(cdcl, cdcl->heap_pos[var]);
+  }
+}
+
+/* Clause database */
+
+static bool watch_push(cdcl_t *cdcl, const lit_t lit, const uint32_t clause) {
+  watch_list_t *list = &cdcl->watches[lit];
+  if (list->nb == list->capacity) {
+    uint32_t capacity = list->capacity > 0 ? 2 * list->capacity : 4;
+    uint32_t *clauses = realloc(list->clauses, capacity * sizeof(uint32_t));
+    if (clauses == NULL) {
+      return false;
+    }
+    list->clauses = clauses;
+    list->capacity = capacity;
+  }
+  list->clauses[list->nb] = clause;
+  list->nb++;
+  return true;
+}
+
+/* Adds a clause of at least two literals, watching the first two */
+static uint32_t clause_add(cdcl_t *cdcl, const lit_t *lits, const size_t size,
+                           const clause_kind_t kind) {
+  if (cdcl->lits_nb + size > cdcl->lits_capacity) {
+    size_t capacity = 2 * (cdcl->lits_nb + size);
+    lit_t *pool = realloc(cdcl->lits, capacity * sizeof(lit_t));
+    if (pool == NULL) {
+      cdcl->failed = true;
+      return REASON_NONE;
+    }
+    cdcl->lits = pool;
+    cdcl->lits_capacity = capacity;
+  }
+  if (cdcl->clauses_nb == cdcl->clauses_capacity) {
+    size_t capacity = 2 * cdcl->clauses_capacity + 16;
+    clause_t *clauses = realloc(cdcl->clauses, capacity * sizeof(clause_t));
+    if (clauses == NULL) {
+      cdcl->failed = true;
+      return REASON_NONE;
+    }
+    cdcl->clauses = clauses;
+    cdcl->clauses_capacity = capacity;
+  }
+
+  uint32_t index = cdcl->clauses_nb;
+  clause_t *clause = &cdcl->clauses[index];
+  clause->start = cdcl->lits_nb;
+  clause->size = size;
+  clause->kind = kind;
+  memcpy(&cdcl->lits[cdcl->lits_nb], lits, size * sizeof(lit_t));
+  cdcl->lits_nb += size;
+
+  if (!watch_push(cdcl, lits[0], index) || !watch_push(cdcl, lits[1], index)) {
+    cdcl->failed = true;
+    return REASON_NONE;
+  }
+  cdcl->clauses_nb++;
+  if (kind == clause_learned) {
+    cdcl->learned_nb++;
+  }
+  return index;
+}
+
+/* Drops the learned clauses longer than average. Only called at level 0,
+ * where no learned clause can be the reason of an assignment that will
+ * ever be analysed. Returns false if a kept clause couldn't be watched. */
+static bool clause_reduce(cdcl_t *cdcl) {
+  size_t total = 0;
+  for (size_t index = 0; index < cdcl->clauses_nb; index++) {
+    if (cdcl->clauses[index].kind == clause_learned) {
+      total += cdcl->clauses[index].size;
+    }
+  }
+  size_t average = cdcl->learned_nb > 0 ? total / cdcl->learned_nb : 0;
+
+  for (size_t var = 0; var < cdcl->vars_nb; var++) {
+    cdcl->reason[var] = REASON_NONE;
+  }
+  for (size_t lit = 0; lit < 2 * cdcl->vars_nb; lit++) {
+    cdcl->watches[lit].nb = 0;
+  }
+
+  /* Compact the clauses (and their literals) that are kept */
+  size_t clauses_nb = 0;
+  size_t lits_nb = 0;
+  for (size_t index = 0; index < cdcl->clauses_nb; index++) {
+    clause_t clause = cdcl->clauses[index];
+    if (clause.kind == clause_learned && clause.size > 2 &&
+        clause.size > average) {
+      cdcl->learned_nb--;
+      cdcl->stats.deleted++;
+      continue;
+    }
+    memmove(&cdcl->lits[lits_nb], &cdcl->lits[clause.start],
+            clause.size * sizeof(lit_t));
+    clause.start = lits_nb;
+    lits_nb += clause.size;
+    cdcl->clauses[clauses_nb] = clause;
+    if (!watch_push(cdcl, cdcl->lits[clause.start], clauses_nb) ||
+        !watch_push(cdcl, cdcl->lits[clause.start + 1], clauses_nb)) {
+      cdcl->failed = true;
+      return false;
+    }
+    clauses_nb++;
+  }
+  cdcl->clauses_nb = clauses_nb;
+  cdcl->lits_nb = lits_nb;
+  return true;
+}
+
+/* Assignment */
+
+static inline void assign(cdcl_t *cdcl, const lit_t lit, const uint32_t reason) {
+  uint32_t var = lit_var(lit);
+  cdcl->value[var] = lit_negated(lit) ? VALUE_FALSE : VALUE_TRUE;
+  cdcl->level[var] = cdcl->levels;
+  cdcl->reason[var] = reason;
+  cdcl->trail[cdcl->trail_nb] = lit;
+  cdcl->trail_nb++;
+}
+
+static void assign_root(cdcl_t *cdcl, const lit_t lit) {
+  uint8_t value = lit_value(cdcl, lit);
+  if (value == VALUE_FALSE) {
+    cdcl->unsatisfiable = true;
+  } else if (value == VALUE_UNDEF) {
+    assign(cdcl, lit, REASON_NONE);
+  }
+}
+
+static void backjump(cdcl_t *cdcl, const size_t level) {
+  if (cdcl->levels <= level) {
+    return;
+  }
+
+  size_t limit = cdcl->trail_lim[level];
+  while (cdcl->trail_nb > limit) {
+    cdcl->trail_nb--;
+    uint32_t var = lit_var(cdcl->trail[cdcl->trail_nb]);
+    cdcl->value[var] = VALUE_UNDEF;
+    cdcl->reason[var] = REASON_NONE;
+    heap_insert(cdcl, var);
+  }
+  cdcl->queue_head = cdcl->trail_nb;
+  cdcl->levels = level;
+}
+
+/* Propagation */
+
+/* 'var' is true: 'other' has to be false */
+static inline bool propagate_exclusion(cdcl_t *cdcl, const uint32_t var,
+                                       const uint32_t other) {
+  uint8_t value = cdcl->value[other];
+  if (value == VALUE_TRUE) {
+    cdcl->conflict = REASON_NONE;
+    cdcl->conflict_lits[0] = lit_make(var, true);
+    cdcl->conflict_lits[1] = lit_make(other, true);
+    return false;
+  }
+  if (value == VALUE_UNDEF) {
+    assign(cdcl, lit_make(other, true), REASON_BINARY | var);
+  }
+  return true;
+}
+
+/* At-most-one: a true variable excludes the same color in its peers and
+ * every other color in its cell */
+static bool propagate_true(cdcl_t *cdcl, const uint32_t var) {
+  size_t size = cdcl->size;
+  size_t cell = var / size;
+  size_t color = var % size;
+
+  for (size_t other = 0; other < size; other++) {
+    if (other != color && !propagate_exclusion(cdcl, var, cell * size + other)) {
+      return false;
+    }
+  }
+
+  const uint16_t *peers = grid_tables_peers(cdcl->tables, cell);
+  for (size_t index = 0; index < cdcl->tables->peers_nb; index++) {
+    if (!propagate_exclusion(cdcl, var, peers[index] * size + color)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Watched literals: visits the clauses watching a literal that became
+ * false, looking for another literal to watch or propagating the last one.
+ * Returns false on a conflict, or if a clause couldn't be moved to another
+ * watch list (the clause is then kept in this one and 'failed' is set). */
+static bool propagate_false(cdcl_t *cdcl, const lit_t false_lit) {
+  watch_list_t *list = &cdcl->watches[false_lit];
+  uint32_t kept = 0;
+  uint32_t index = 0;
+
+  while (index < list->nb) {
+    uint32_t clause_id = list->clauses[index];
+    index++;
+    clause_t *clause = &cdcl->clauses[clause_id];
+    lit_t *lits = &cdcl->lits[clause->start];
+
+    if (lits[0] == false_lit) {
+      lits[0] = lits[1];
+      lits[1] = false_lit;
+    }
+    if (lit_value(cdcl, lits[0]) == VALUE_TRUE) {
+      list->clauses[kept] = clause_id;
+      kept++;
+      continue;
+    }
+
+    bool moved = false;
+    for (size_t other = 2; other < clause->size; other++) {
+      if (lit_value(cdcl, lits[other]) != VALUE_FALSE) {
+        if (!watch_push(cdcl, lits[other], clause_id)) {
+          cdcl->failed = true;
+          break;
+        }
+        lits[1] = lits[other];
+        lits[other] = false_lit;
+        moved = true;
+        break;
+      }
+    }
+    if (moved) {
+      continue;
+    }
+
+    list->clauses[kept] = clause_id;
+    kept++;
+    if (cdcl->failed || lit_value(cdcl, lits[0]) == VALUE_FALSE) {
+      cdcl->conflict = clause_id;
+      while (index < list->nb) {
+        list->clauses[kept] = list->clauses[index];
+        kept++;
+        index++;
+      }
+      list->nb = kept;
+      return false;
+    }
+    assign(cdcl, lits[0], clause_id);
+  }
+
+  list->nb = kept;
+  return true;
+}
+
+static bool propagate(cdcl_t *cdcl) {
+  while (cdcl->queue_head < cdcl->trail_nb) {
+    lit_t lit = cdcl->trail[cdcl->queue_head];
+    cdcl->queue_head++;
+    cdcl->stats.propagations++;
+
+    if (!lit_negated(lit) && !propagate_true(cdcl, lit_var(lit))) {
+      return false;
+    }
+    if (!propagate_false(cdcl, lit_not(lit))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Conflict analysis */
+
+/* Literals (all false) of the reason of 'var', or of the conflict when
+ * 'var' is REASON_NONE, 'var' itself excluded */
+static size_t reason_lits(const cdcl_t *cdcl, const uint32_t var,
+                          const lit_t **lits, lit_t *binary) {
+  uint32_t reason = var == REASON_NONE ? cdcl->conflict : cdcl->reason[var];
+
+  if (var == REASON_NONE && reason == REASON_NONE) {
+    *lits = cdcl->conflict_lits;
+    return 2;
+  }
+  if (reason & REASON_BINARY) {
+    *binary = lit_make(reason & ~REASON_BINARY, true);
+    *lits = binary;
+    return 1;
+  }
+  *lits = &cdcl->lits[cdcl->clauses[reason].start];
+  return cdcl->clauses[reason].size;
+}
+
+/* First unique implication point learning, returns the learned clause size
+ * (asserting literal first, then a literal of the backjump level) */
+static size_t analyze(cdcl_t *cdcl, size_t *backjump_level) {
+  size_t learned_nb = 1;
+  size_t pending = 0;
+  size_t trail_index = cdcl->trail_nb;
+  uint32_t var = REASON_NONE;
+  lit_t binary;
+
+  do {
+    const lit_t *lits;
+    size_t lits_nb = reason_lits(cdcl, var, &lits, &binary);
+
+    for (size_t index = 0; index < lits_nb; index++) {
+      uint32_t other = lit_var(lits[index]);
+      if (other == var || cdcl->seen[other] || cdcl->level[other] == 0) {
+        continue;
+      }
+      cdcl->seen[other] = 1;
+      activity_bump(cdcl, other);
+      if (cdcl->level[other] >= cdcl->levels) {
+        pending++;
+      } else {
+        cdcl->learned[learned_nb] = lits[index];
+        learned_nb++;
+      }
+    }
+
+    do {
+      trail_index--;
+    } while (!cdcl->seen[lit_var(cdcl->trail[trail_index])]);
+    var = lit_var(cdcl->trail[trail_index]);
+    cdcl->seen[var] = 0;
+    pending--;
+  } while (pending > 0);
+
+  cdcl->learned[0] = lit_not(cdcl->trail[trail_index]);
+
+  /* Put a literal of the backjump level second so that it is watched */
+  *backjump_level = 0;
+  for (size_t index = 1; index < learned_nb; index++) {
+    uint32_t other = lit_var(cdcl->learned[index]);
+    cdcl->seen[other] = 0;
+    if (cdcl->level[other] > *backjump_level) {
+      *backjump_level = cdcl->level[other];
+      lit_t swap = cdcl->learned[1];
+      cdcl->learned[1] = cdcl->learned[index];
+      cdcl->learned[index] = swap;
+    }
+  }
+  return learned_nb;
+}
+
+/* Adds an asserting clause (first literal unassigned after backjumping) */
+static bool learn(cdcl_t *cdcl, const size_t size, const clause_kind_t kind) {
+  if (size == 1) {
+    assign(cdcl, cdcl->learned[0], REASON_NONE);
+    return true;
+  }
+
+  uint32_t clause = clause_add(cdcl, cdcl->learned, size, kind);
+  if (clause == REASON_NONE) {
+    return false;
+  }
+  assign(cdcl, cdcl->learned[0], clause);
+  return true;
+}
+
+/* Search */
+
+static size_t luby(size_t index) {
+  size_t size = 1;
+  size_t power = 0;
+  while (size < index + 1) {
+    power++;
+    size = 2 * size + 1;
+  }
+  while (size - 1 != index) {
+    size = (size - 1) / 2;
+    power--;
+    index %= size;
+  }
+  return (size_t)1 << power;
+}
+
+static void report(cdcl_t *cdcl, cdcl_solution_t on_solution, void *data,
+                   bool *stop) {
+  if (on_solution == NULL) {
+    return;
+  }
+
+  grid_t *solution = grid_copy(cdcl->grid);
+  if (solution == NULL) {
+    *stop = true;
+    return;
+  }
+
+  size_t size = cdcl->size;
+  for (size_t var = 0; var < cdcl->vars_nb; var++) {
+    if (cdcl->value[var] == VALUE_TRUE) {
+      choice_t choice = {var / size / size, (var / size) % size,
+                         colors_set(var % size)};
+      grid_choice_apply(solution, choice);
+    }
+  }
+
+  if (!on_solution(solution, data)) {
+    *stop = true;
+  }
+  grid_free(solution);
+}
+
+size_t cdcl_search(cdcl_t *cdcl, cdcl_solution_t on_solution, void *data) {
+  if (cdcl == NULL || cdcl->unsatisfiable) {
+    return 0;
+  }
+
+  size_t solutions = 0;
+  size_t conflicts = 0;
+  size_t conflicts_limit = RESTART_BASE * luby(0);
+  bool stop = false;
+
+  while (!stop) {
+    if (!propagate(cdcl)) {
+      if (cdcl->failed) {
+        break;
+      }
+      cdcl->stats.conflicts++;
+      if (cdcl->levels == 0) {
+        break;
+      }
+      conflicts++;
+
+      size_t level;
+      size_t size = analyze(cdcl, &level);
+      backjump(cdcl, level);
+      if (!learn(cdcl, size, clause_learned)) {
+        break;
+      }
+      cdcl->stats.learned++;
+      cdcl->activity_inc /= ACTIVITY_DECAY;
+      continue;
+    }
+
+    if (conflicts >= conflicts_limit) {
+      backjump(cdcl, 0);
+      cdcl->stats.restarts++;
+      conflicts = 0;
+      conflicts_limit = RESTART_BASE * luby(cdcl->stats.restarts);
+      if (cdcl->learned_nb > cdcl->learned_limit) {
+        if (!clause_reduce(cdcl)) {
+          break;
+        }
+        cdcl->learned_limit *= LEARNED_LIMIT_GROWTH;
+      }
+      continue;
+    }
+
+    uint32_t var = REASON_NONE;
+    while (cdcl->heap_nb > 0) {
+      var = heap_pop(cdcl);
+      if (cdcl->value[var] == VALUE_UNDEF) {
+        break;
+      }
+      var = REASON_NONE;
+    }
+
+    if (var == REASON_NONE) {
+      /* Every variable is assigned: a solution, block it to go on */
+      solutions++;
+      report(cdcl, on_solution, data, &stop);
+      if (stop || cdcl->levels == 0) {
+        break;
+      }
+
+      size_t size = cdcl->levels;
+      for (size_t level = 0; level < size; level++) {
+        lit_t decision = cdcl->trail[cdcl->trail_lim[size - 1 - level]];
+        cdcl->learned[level] = lit_not(decision);
+      }
+      backjump(cdcl, size - 1);
+      if (!learn(cdcl, size, clause_blocking)) {
+        break;
+      }
+      continue;
+    }
+
+    cdcl->stats.decisions++;
+    cdcl->trail_lim[cdcl->levels] = cdcl->trail_nb;
+    cdcl->levels++;
+    if (cdcl->levels > cdcl->stats.max_level) {
+      cdcl->stats.max_level = cdcl->levels;
+    }
+    assign(cdcl, lit_make(var, false), REASON_NONE);
+  }
+
+  return solutions;
+}
+
+/* Allocation */
+
+cdcl_t *cdcl_alloc(const grid_t *grid) {
+  if (grid == NULL) {
+    return NULL;
+  }
+
+  cdcl_t *cdcl = calloc(1, sizeof(cdcl_t));
+  if (cdcl == NULL) {
+    return NULL;
+  }
+
+  size_t size = grid_get_size(grid);
+  size_t vars_nb = size * size * size;
+  cdcl->size = size;
+  cdcl->vars_nb = vars_nb;
+  cdcl->tables = grid_tables(size);
+  cdcl->grid = grid_copy(grid);
+  cdcl->value = malloc(vars_nb * sizeof(uint8_t));
+  cdcl->level = calloc(vars_nb, sizeof(uint32_t));
+  cdcl->reason = malloc(vars_nb * sizeof(uint32_t));
+  cdcl->trail = malloc(vars_nb * sizeof(lit_t));
+  cdcl->trail_lim = malloc((vars_nb + 1) * sizeof(uint32_t));
+  cdcl->watches = calloc(2 * vars_nb, sizeof(watch_list_t));
+  cdcl->seen = calloc(vars_nb, sizeof(uint8_t));
+  cdcl->learned = malloc((vars_nb + 1) * sizeof(lit_t));
+  cdcl->activity = calloc(vars_nb, sizeof(double));
+  cdcl->heap = malloc(vars_nb * sizeof(uint32_t));
+  cdcl->heap_pos = malloc(vars_nb * sizeof(uint32_t));
+  if (cdcl->grid == NULL || cdcl->value == NULL || cdcl->level == NULL ||
+      cdcl->reason == NULL || cdcl->trail == NULL || cdcl->trail_lim == NULL ||
+      cdcl->watches == NULL || cdcl->seen == NULL || cdcl->learned == NULL ||
+      cdcl->activity == NULL || cdcl->heap == NULL || cdcl->heap_pos == NULL) {
+    cdcl_free(cdcl);
+    return NULL;
+  }
+
+  cdcl->activity_inc = 1.0;
+  cdcl->learned_limit = LEARNED_LIMIT_MIN;
+  for (size_t var = 0; var < vars_nb; var++) {
+    cdcl->value[var] = VALUE_UNDEF;
+    cdcl->reason[var] = REASON_NONE;
+    cdcl->heap_pos[var] = NOT_IN_HEAP;
+  }
+
+  /* Candidates outside the domains are false, cells with fewer candidates
+   * start with a higher activity */
+  for (size_t cell = 0; cell < size * size; cell++) {
+    colors_t colors = get_grid_color(grid, cell / size, cell % size);
+    size_t count = colors_count(colors);
+    for (size_t color = 0; color < size; color++) {
+      uint32_t var = cell * size + color;
+      if (colors_is_in(colors, color)) {
+        cdcl->activity[var] = 1.0 / count;
+        heap_insert(cdcl, var);
+      } else {
+        assign_root(cdcl, lit_make(var, true));
+      }
+    }
+  }
+
+  /* At-least-one clauses: every cell, and every color of every unit */
+  lit_t group[size];
+  for (size_t cell = 0; cell < size * size; cell++) {
+    for (size_t color = 0; color < size; color++) {
+      group[color] = lit_make(cell * size + color, false);
+    }
+    if (size == 1) {
+      assign_root(cdcl, group[0]);
+    } else if (clause_add(cdcl, group, size, clause_group) == REASON_NONE) {
+      cdcl_free(cdcl);
+      return NULL;
+    }
+  }
+  for (size_t unit = 0; size > 1 && unit < cdcl->tables->units_nb; unit++) {
+    const uint16_t *cells = grid_tables_unit(cdcl->tables, unit);
+    for (size_t color = 0; color < size; color++) {
+      for (size_t index = 0; index < size; index++) {
+        group[index] = lit_make(cells[index] * size + color, false);
+      }
+      if (clause_add(cdcl, group, size, clause_group) == REASON_NONE) {
+        cdcl_free(cdcl);
+        return NULL;
+      }
+    }
+  }
+
+  return cdcl;
+}
+
+void cdcl_free(cdcl_t *cdcl) {
+  if (cdcl == NULL) {
+    return;
+  }
+
+  if (cdcl->watches != NULL) {
+    for (size_t lit = 0; lit < 2 * cdcl->vars_nb; lit++) {
+      free(cdcl->watches[lit].clauses);
+    }
+  }
+  grid_free(cdcl->grid);
+  free(cdcl->value);
+  free(cdcl->level);
+  free(cdcl->reason);
+  free(cdcl->trail);
+  free(cdcl->trail_lim);
+  free(cdcl->watches);
+  free(cdcl->seen);
+  free(cdcl->learned);
+  free(cdcl->activity);
+  free(cdcl->heap);
+  free(cdcl->heap_pos);
+  free(cdcl->lits);
+  free(cdcl->clauses);
+  free(cdcl);
+}
+
+bool cdcl_failed(const cdcl_t *cdcl) {
+  return cdcl != NULL && cdcl->failed;
+}
+
+cdcl_stats_t cdcl_stats(const cdcl_t *cdcl) {
+  cdcl_stats_t empty = {0, 0, 0, 0, 0, 0, 0};
+  if (cdcl == NULL) {
+    return empty;
+  }
+  return cdcl->stats;
+}
@@ -2,65 +2,7 @@
 
 #include <time.h>
 
-/* Bitwise */
-
-bool colors_is_equal(const colors_t colors1, const colors_t colors2) {
-  return colors1 == colors2;
-}
-
-bool colors_is_in(const colors_t colors, const size_t color_id) {
-  return !((colors & colors_set(color_id)) == 0ULL);
-}
-
-bool colors_is_singleton(const colors_t colors) {
-  return (colors != 0) && ((colors & (colors - 1)) == 0);
-}
-
-bool colors_is_subset(const colors_t colors1, const colors_t colors2) {
-  return (colors1 & colors2) == colors1;
-}
-
-colors_t colors_add(const colors_t colors, const size_t color_id) {
-  return colors | colors_set(color_id);
-}
-
-colors_t colors_and(const colors_t colors1, const colors_t colors2) {
-  return colors1 & colors2;
-}
-
-colors_t colors_discard(const colors_t colors, const size_t color_id) {
-  return colors & ~(colors_set(color_id));
-}
-
-colors_t colors_empty(void) {
-  return 0ULL;
-}
-
-colors_t colors_full(const size_t size) {
-  if (size >= MAX_COLORS) {
-    return ~0ULL;
-  }
-  return (1ULL << size) - 1ULL;
-}
-
-colors_t colors_leftmost(const colors_t colors) {
-  colors_t tmp = colors;
-  tmp |= (tmp >> 1);
-  tmp |= (tmp >> 2);
-  tmp |= (tmp >> 4);
-  tmp |= (tmp >> 8);
-  tmp |= (tmp >> 16);
-  tmp |= (tmp >> 32);
-  return (tmp - (tmp >> 1));
-}
-
-colors_t colors_negate(const colors_t colors) {
-  return ~colors;
-}
-
-colors_t colors_or(const colors_t colors1, const colors_t colors2) {
-  return colors1 | colors2;
-}
+/* Random */
 
 /* Here we suppose that the seed has already been initialized in the main */
 colors_t colors_random(const colors_t colors) {
@@ -68,60 +10,20 @@ colors_t colors_random(const colors_t colors) {
     return 0;
   }
 
-  colors_t copy = colors;
-  size_t count = colors_count(colors);
-  int index = rand() % count;
-
-  while (index > 0) {
-    colors_t singleton = colors_rightmost(copy);
-    copy = colors_subtract(copy, singleton);
-    index--;
-  }
-
-  return colors_rightmost(copy);
-}
-
-colors_t colors_rightmost(const colors_t colors) {
-  return colors & -colors;
-}
-
-colors_t colors_set(const size_t color_id) {
-  if (color_id > MAX_COLORS) {
-    return 0ULL;
-  }
-  return 1ULL << color_id;
-}
-
-colors_t colors_subtract(const colors_t colors1, const colors_t colors2) {
-  return colors1 & ~colors2;
-}
-
-colors_t colors_xor(const colors_t colors1, const colors_t colors2) {
-  return colors1 ^ colors2;
-}
-
-size_t colors_count(const colors_t colors) {
-  colors_t B5 = (1ULL << 32) - 1ULL;
-  colors_t B4 = B5 ^ (B5 << 16);
-  colors_t B3 = B4 ^ (B4 << 8);
-  colors_t B2 = B3 ^ (B3 << 4);
-  colors_t B1 = B2 ^ (B2 << 2);
-  colors_t B0 = B1 ^ (B1 << 1);
-
-  size_t count = colors;
-  count = ((count >> 1) & B0) + (count & B0);
-  count = ((count >> 2) & B1) + (count & B1);
-  count = ((count >> 4) + count) & B2;
-  count = ((count >> 8) + count) & B3;
-  count = ((count >> 16) + count) & B4;
-  count = ((count >> 32) + count) & B5;
-
-  return count;
+  return colors_select(colors, rand() % colors_count(colors));
 }
 
 /* Heuristics and  subgrid functions  */
 
-bool cross_hatching_heuristic(colors_t *subgrid[], size_t size) {
+/* The heuristics are written once, for any size, and always inlined: the
+ * public functions below call them with a runtime size, while the per-size
+ * instances call them with a constant one, so that the compiler can unroll
+ * their loops and fold colors_full(size). Only these per-unit heuristics
+ * are specialized: the grid functions (propagation, scans, choices) keep a
+ * runtime size and reach the instances through one switch per unit. */
+#define INLINE static inline __attribute__((always_inline))
+
+INLINE bool cross_hatching_of(colors_t *subgrid[], const size_t size) {
   colors_t singleton = colors_empty();
   bool changed = false;
 
@@ -145,7 +47,7 @@ bool cross_hatching_heuristic(colors_t *subgrid[], size_t size) {
   return changed;
 }
 
-bool lone_number_heuristic(colors_t *subgrid[], const size_t size) {
+INLINE bool lone_number_of(colors_t *subgrid[], const size_t size) {
   bool result = false;
   size_t final_index = 0;
   int count;
@@ -167,76 +69,194 @@ bool lone_number_heuristic(colors_t *subgrid[], const size_t size) {
   return result;
 }
 
-bool naked_subset_heuristic(colors_t *subgrid[], const size_t size) {
-  bool result = false;
+/* Subsets: k cells of a unit whose union holds k colors own these colors
+ * (naked subset), and k colors of a unit found in k cells only own these
+ * cells (hidden subset, the same search on the unit transposed into one set
+ * of cells per color). Sets are grown while the popcount of their union
+ * stays within the limit, so large units only try small unions. */
 
-  for (size_t id_one = 0; id_one < size - 1; id_one++) {
-    int count = 1;
-    int color_nb = 0;
+#define SUBSET_BUDGET 4096
 
-    if (!colors_is_singleton(*subgrid[id_one]) &&
-        *subgrid[id_one] != colors_full(size)) {
-      color_nb = colors_count(*subgrid[id_one]);
+static size_t subset_max_order = SUBSET_DEFAULT_ORDER;
 
-      for (size_t id_two = id_one + 1; id_two < size; id_two++) {
-        if (id_one != id_two &&
-            colors_is_equal(*subgrid[id_one], *subgrid[id_two])) {
-          count++;
-        }
-      }
+void subgrid_subset_limit(const size_t max_order) {
+  subset_max_order = max_order < 2               ? 2
+                     : max_order > MAX_COLORS / 2 ? MAX_COLORS / 2
+                                                  : max_order;
+}
+
+typedef struct {
+  colors_t **subgrid;
+  size_t size;
+  bool hidden;               /* elements are colors, sets are cells */
+  colors_t sets[MAX_COLORS]; /* set of each element (0: not eligible) */
+  size_t max_order;
+  size_t budget; /* sets left to try, bounds the search on wide units */
+} subsets_t;
+
+/* Removes the colors of a subset from the rest of the unit, returns whether
+ * a cell changed */
+static bool subset_apply(subsets_t *subsets, const colors_t elements,
+                         const colors_t cover) {
+  bool result = false;
+  for (size_t index = 0; index < subsets->size; index++) {
+    colors_t *cell = subsets->subgrid[index];
+    colors_t reduced = subsets->hidden
+                           ? (colors_is_in(cover, index)
+                                  ? colors_and(*cell, elements)
+                                  : *cell)
+                           : (colors_is_in(elements, index)
+                                  ? *cell
+                                  : colors_subtract(*cell, cover));
+    if (reduced != *cell) {
+      *cell = reduced;
+      result = true;
     }
+  }
+  return result;
+}
 
-    if (color_nb == count) {
+/* Grows the subset with the elements from 'first' on, as long as the union
+ * of their sets stays within the limit */
+static bool subset_search(subsets_t *subsets, const size_t first,
+                          const size_t depth, const colors_t elements,
+                          const colors_t cover) {
+  if (depth >= 2 && colors_count(cover) == depth &&
+      subset_apply(subsets, elements, cover)) {
+    return true;
+  }
+  if (depth == subsets->max_order) {
+    return false;
+  }
 
-      for (size_t id_three = 0; id_three < size; id_three++) {
-        if (id_three != id_one &&
-            !colors_is_equal(*subgrid[id_one], *subgrid[id_three]) &&
-            colors_and(*subgrid[id_one], *subgrid[id_three]) != 0) {
-          *subgrid[id_three] =
-              colors_subtract(*subgrid[id_three], *subgrid[id_one]);
-          result = true;
-        }
-      }
+  for (size_t element = first; element < subsets->size; element++) {
+    if (subsets->sets[element] == colors_empty()) {
+      continue;
+    }
+    colors_t wider = colors_or(cover, subsets->sets[element]);
+    if (colors_count(wider) > subsets->max_order) {
+      continue;
+    }
+    if (subsets->budget == 0) {
+      return false;
+    }
+    subsets->budget--;
+    if (subset_search(subsets, element + 1, depth + 1,
+                      colors_add(elements, element), wider)) {
+      return true;
     }
   }
+  return false;
+}
 
-  return result;
+static void subsets_init(subsets_t *subsets, colors_t *subgrid[],
+                         const size_t size, const bool hidden) {
+  subsets->subgrid = subgrid;
+  subsets->size = size;
+  subsets->hidden = hidden;
+  subsets->max_order = subset_max_order;
+  subsets->budget = SUBSET_BUDGET;
+  for (size_t element = 0; element < size; element++) {
+    subsets->sets[element] = colors_empty();
+  }
 }
 
-bool hidden_subset_heuristic(colors_t *subgrid[], const size_t size) {
-  bool result = false;
-  size_t count;
-  size_t color_nb;
-  for (size_t id_one = 0; id_one < size; id_one++) {
-    count = 1;
-    color_nb = 0;
-    if (!colors_is_singleton(*subgrid[id_one]) &&
-        *subgrid[id_one] != colors_full(size)) {
-      color_nb = colors_count(*subgrid[id_one]);
-      for (size_t id_two = 0; id_two < size; id_two++) {
-        if (id_one != id_two &&
-            *subgrid[id_two] !=
-                colors_subtract(*subgrid[id_one], *subgrid[id_two])) {
-
-          count++;
-        }
-      }
+/* Keeps the sets of 2 to 'max_order' bits, smaller ones are singletons
+ * already handled by the cross-hatching and lone number heuristics */
+static void subsets_filter(subsets_t *subsets) {
+  for (size_t element = 0; element < subsets->size; element++) {
+    size_t count = colors_count(subsets->sets[element]);
+    if (count < 2 || count > subsets->max_order) {
+      subsets->sets[element] = colors_empty();
+    }
+  }
+}
 
-      if (color_nb == count) {
-        for (size_t id_three = 0; id_three < size; id_three++) {
-
-          if (id_three != id_one &&
-              *subgrid[id_three] !=
-                  colors_subtract(*subgrid[id_one], *subgrid[id_three])) {
-            *subgrid[id_three] =
-                colors_and(*subgrid[id_three], *subgrid[id_one]);
-            result = true;
-          }
-        }
-      }
+INLINE bool naked_subset_of(colors_t *subgrid[], const size_t size) {
+  subsets_t cells;
+  subsets_init(&cells, subgrid, size, false);
+  for (size_t index = 0; index < size; index++) {
+    cells.sets[index] = *subgrid[index];
+  }
+  subsets_filter(&cells);
+  return subset_search(&cells, 0, 0, colors_empty(), colors_empty());
+}
+
+INLINE bool hidden_subset_of(colors_t *subgrid[], const size_t size) {
+  subsets_t colors;
+  subsets_init(&colors, subgrid, size, true);
+
+  /* Transposition of the unit: the cells of each color not placed yet */
+  colors_t placed = colors_empty();
+  for (size_t index = 0; index < size; index++) {
+    if (colors_is_singleton(*subgrid[index])) {
+      placed = colors_or(placed, *subgrid[index]);
     }
   }
-  return result;
+  for (size_t index = 0; index < size; index++) {
+    colors_t candidates = colors_subtract(*subgrid[index], placed);
+    while (candidates != colors_empty()) {
+      size_t color = colors_pop(&candidates);
+      colors.sets[color] = colors_add(colors.sets[color], index);
+    }
+  }
+  subsets_filter(&colors);
+  return subset_search(&colors, 0, 0, colors_empty(), colors_empty());
+}
+
+INLINE bool subgrid_singles_of(colors_t *subgrid[], const size_t size) {
+  bool changes = false;
+
+  while (1) {
+    if (cross_hatching_of(subgrid, size)) {
+      changes = true;
+      continue;
+    }
+    if (lone_number_of(subgrid, size)) {
+      changes = true;
+      continue;
+    }
+    break;
+  }
+  return changes;
+}
+
+INLINE bool subgrid_subsets_of(colors_t *subgrid[], const size_t size) {
+  bool changes = false;
+
+  while (naked_subset_of(subgrid, size)) {
+    changes = true;
+  }
+  while (hidden_subset_of(subgrid, size)) {
+    changes = true;
+  }
+  return changes;
+}
+
+#define SUBGRID_INSTANCE(size)                                                 \
+  static bool subgrid_singles_##size(colors_t *subgrid[]) {                    \
+    return subgrid_singles_of(subgrid, size);                                  \
+  }                                                                            \
+  static bool subgrid_subsets_##size(colors_t *subgrid[]) {                    \
+    return subgrid_subsets_of(subgrid, size);                                  \
+  }
+SUBGRID_SIZES(SUBGRID_INSTANCE)
+#undef SUBGRID_INSTANCE
+
+bool cross_hatching_heuristic(colors_t *subgrid[], size_t size) {
+  return cross_hatching_of(subgrid, size);
+}
+
+bool lone_number_heuristic(colors_t *subgrid[], const size_t size) {
+  return lone_number_of(subgrid, size);
+}
+
+bool naked_subset_heuristic(colors_t *subgrid[], const size_t size) {
+  return naked_subset_of(subgrid, size);
+}
+
+bool hidden_subset_heuristic(colors_t *subgrid[], const size_t size) {
+  return hidden_subset_of(subgrid, size);
 }
 
 bool subgrid_consistency(colors_t subgrid[], const size_t size) {
@@ -264,29 +284,39 @@ bool subgrid_consistency(colors_t subgrid[], const size_t size) {
   return color_count == colors_full(size);
 }
 
-bool subgrid_heuristics(colors_t *subgrid[], const size_t size) {
+bool subgrid_singles(colors_t *subgrid[], const size_t size) {
   if (subgrid == NULL) {
     return false;
   }
-  bool changes = false;
 
-  while (1) {
-    if (cross_hatching_heuristic(subgrid, size)) {
-      changes = true;
-      continue;
-    }
-    if (lone_number_heuristic(subgrid, size)) {
-      changes = true;
-      continue;
-    }
-    break;
+  switch (size) {
+#define SUBGRID_CASE(size)                                                     \
+  case size:                                                                   \
+    return subgrid_singles_##size(subgrid);
+    SUBGRID_SIZES(SUBGRID_CASE)
+#undef SUBGRID_CASE
+  default:
+    return subgrid_singles_of(subgrid, size);
   }
+}
 
-  while (naked_subset_heuristic(subgrid, size)) {
-    changes = true;
+bool subgrid_subsets(colors_t *subgrid[], const size_t size) {
+  if (subgrid == NULL) {
+    return false;
   }
-  while (hidden_subset_heuristic(subgrid, size)) {
-    changes = true;
+
+  switch (size) {
+#define SUBGRID_CASE(size)                                                     \
+  case size:                                                                   \
+    return subgrid_subsets_##size(subgrid);
+    SUBGRID_SIZES(SUBGRID_CASE)
+#undef SUBGRID_CASE
+  default:
+    return subgrid_subsets_of(subgrid, size);
   }
-  return changes;
+}
+
+bool subgrid_heuristics(colors_t *subgrid[], const size_t size) {
+  bool changes = subgrid_singles(subgrid, size);
+  return subgrid_subsets(subgrid, size) || changes;
 }
@@ -0,0 +1,258 @@
+#include "dlx.h"
+
+#include <stdint.h>
+
+#define DLX_CONSTRAINTS 4 /* cell, row-color, column-color, block-color */
+
+/* Node 0 is the root, nodes 1..columns_nb are the column headers and the
+ * candidate rows follow, DLX_CONSTRAINTS nodes each */
+struct _dlx_t {
+  size_t size;
+  size_t columns_nb;
+  uint32_t *left;
+  uint32_t *right;
+  uint32_t *up;
+  uint32_t *down;
+  uint32_t *column;    /* column header of every node */
+  uint32_t *candidate; /* candidate (cell * size + color) of every node */
+  uint32_t *count;     /* number of nodes in every column */
+  uint32_t *chosen;    /* rows of the partial solution, one per level */
+  grid_t *grid;        /* grid the matrix was built from */
+  dlx_solution_t on_solution;
+  void *data;
+  bool stopped;
+  dlx_stats_t stats;
+};
+
+/* Matrix building */
+
+static void dlx_column_append(dlx_t *dlx, const uint32_t column,
+                              const uint32_t node) {
+  dlx->column[node] = column;
+  dlx->down[node] = column;
+  dlx->up[node] = dlx->up[column];
+  dlx->down[dlx->up[column]] = node;
+  dlx->up[column] = node;
+  dlx->count[column]++;
+}
+
+static void dlx_row_append(dlx_t *dlx, const uint32_t node, size_t row,
+                           size_t col, size_t color) {
+  size_t size = dlx->size;
+  size_t block_size = grid_tables(size)->block_size;
+  size_t block = (row / block_size) * block_size + col / block_size;
+  uint32_t columns[DLX_CONSTRAINTS] = {
+      1 + row * size + col, 1 + size * size + row * size + color,
+      1 + 2 * size * size + col * size + color,
+      1 + 3 * size * size + block * size + color};
+
+  for (size_t index = 0; index < DLX_CONSTRAINTS; index++) {
+    uint32_t current = node + index;
+    dlx->left[current] = node + (index + DLX_CONSTRAINTS - 1) % DLX_CONSTRAINTS;
+    dlx->right[current] = node + (index + 1) % DLX_CONSTRAINTS;
+    dlx->candidate[current] = (row * size + col) * size + color;
+    dlx_column_append(dlx, columns[index], current);
+  }
+}
+
+dlx_t *dlx_alloc(const grid_t *grid) {
+  if (grid == NULL) {
+    return NULL;
+  }
+
+  size_t size = grid_get_size(grid);
+  size_t candidates_nb = 0;
+  for (size_t row = 0; row < size; row++) {
+    for (size_t col = 0; col < size; col++) {
+      candidates_nb += colors_count(get_grid_color(grid, row, col));
+    }
+  }
+
+  dlx_t *dlx = calloc(1, sizeof(dlx_t));
+  if (dlx == NULL) {
+    return NULL;
+  }
+
+  dlx->size = size;
+  dlx->columns_nb = DLX_CONSTRAINTS * size * size;
+  size_t nodes_nb = 1 + dlx->columns_nb + DLX_CONSTRAINTS * candidates_nb;
+  dlx->left = malloc(nodes_nb * sizeof(uint32_t));
+  dlx->right = malloc(nodes_nb * sizeof(uint32_t));
+  dlx->up = malloc(nodes_nb * sizeof(uint32_t));
+  dlx->down = malloc(nodes_nb * sizeof(uint32_t));
+  dlx->column = malloc(nodes_nb * sizeof(uint32_t));
+  dlx->candidate = malloc(nodes_nb * sizeof(uint32_t));
+  dlx->count = calloc(dlx->columns_nb + 1, sizeof(uint32_t));
+  dlx->chosen = malloc((size * size + 1) * sizeof(uint32_t));
+  dlx->grid = grid_copy(grid);
+  if (dlx->left == NULL || dlx->right == NULL || dlx->up == NULL ||
+      dlx->down == NULL || dlx->column == NULL || dlx->candidate == NULL ||
+      dlx->count == NULL || dlx->chosen == NULL || dlx->grid == NULL) {
+    dlx_free(dlx);
+    return NULL;
+  }
+
+  /* Root and column headers form the circular header list */
+  for (uint32_t node = 0; node <= dlx->columns_nb; node++) {
+    dlx->left[node] = node == 0 ? dlx->columns_nb : node - 1;
+    dlx->right[node] = node == dlx->columns_nb ? 0 : node + 1;
+    dlx->up[node] = node;
+    dlx->down[node] = node;
+    dlx->column[node] = node;
+  }
+
+  uint32_t node = dlx->columns_nb + 1;
+  for (size_t row = 0; row < size; row++) {
+    for (size_t col = 0; col < size; col++) {
+      colors_t colors = get_grid_color(grid, row, col);
+      for (size_t color = 0; color < size; color++) {
+        if (colors_is_in(colors, color)) {
+          dlx_row_append(dlx, node, row, col, color);
+          node += DLX_CONSTRAINTS;
+        }
+      }
+    }
+  }
+
+  return dlx;
+}
+
+void dlx_free(dlx_t *dlx) {
+  if (dlx == NULL) {
+    return;
+  }
+  free(dlx->left);
+  free(dlx->right);
+  free(dlx->up);
+  free(dlx->down);
+  free(dlx->column);
+  free(dlx->candidate);
+  free(dlx->count);
+  free(dlx->chosen);
+  grid_free(dlx->grid);
+  free(dlx);
+}
+
+/* Dancing links */
+
+static void dlx_cover(dlx_t *dlx, const uint32_t column) {
+  dlx->right[dlx->left[column]] = dlx->right[column];
+  dlx->left[dlx->right[column]] = dlx->left[column];
+
+  for (uint32_t row = dlx->down[column]; row != column; row = dlx->down[row]) {
+    for (uint32_t node = dlx->right[row]; node != row;
+         node = dlx->right[node]) {
+      dlx->down[dlx->up[node]] = dlx->down[node];
+      dlx->up[dlx->down[node]] = dlx->up[node];
+      dlx->count[dlx->column[node]]--;
+    }
+  }
+}
+
+static void dlx_uncover(dlx_t *dlx, const uint32_t column) {
+  for (uint32_t row = dlx->up[column]; row != column; row = dlx->up[row]) {
+    for (uint32_t node = dlx->left[row]; node != row; node = dlx->left[node]) {
+      dlx->count[dlx->column[node]]++;
+      dlx->down[dlx->up[node]] = node;
+      dlx->up[dlx->down[node]] = node;
+    }
+  }
+
+  dlx->right[dlx->left[column]] = column;
+  dlx->left[dlx->right[column]] = column;
+}
+
+static uint32_t dlx_smallest_column(const dlx_t *dlx) {
+  uint32_t best = dlx->right[0];
+  for (uint32_t column = dlx->right[best]; column != 0;
+       column = dlx->right[column]) {
+    if (dlx->count[column] < dlx->count[best]) {
+      best = column;
+      if (dlx->count[best] <= 1) {
+        break;
+      }
+    }
+  }
+  return best;
+}
+
+static void dlx_report(dlx_t *dlx, const size_t level) {
+  if (dlx->on_solution == NULL) {
+    return;
+  }
+
+  grid_t *solution = grid_copy(dlx->grid);
+  if (solution == NULL) {
+    dlx->stopped = true;
+    return;
+  }
+
+  size_t size = dlx->size;
+  for (size_t index = 0; index < level; index++) {
+    uint32_t candidate = dlx->candidate[dlx->chosen[index]];
+    choice_t choice = {candidate / size / size, (candidate / size) % size,
+                       colors_set(candidate % size)};
+    grid_choice_apply(solution, choice);
+  }
+
+  if (!dlx->on_solution(solution, dlx->data)) {
+    dlx->stopped = true;
+  }
+  grid_free(solution);
+}
+
+static size_t dlx_search_level(dlx_t *dlx, const size_t level) {
+  if (level > dlx->stats.max_level) {
+    dlx->stats.max_level = level;
+  }
+  if (dlx->right[0] == 0) {
+    dlx_report(dlx, level);
+    return 1;
+  }
+
+  uint32_t column = dlx_smallest_column(dlx);
+  if (dlx->count[column] == 0) {
+    dlx->stats.dead_ends++;
+    return 0;
+  }
+
+  size_t solutions = 0;
+  dlx_cover(dlx, column);
+  for (uint32_t row = dlx->down[column]; row != column && !dlx->stopped;
+       row = dlx->down[row]) {
+    dlx->chosen[level] = row;
+    dlx->stats.nodes++;
+    for (uint32_t node = dlx->right[row]; node != row;
+         node = dlx->right[node]) {
+      dlx_cover(dlx, dlx->column[node]);
+    }
+
+    solutions += dlx_search_level(dlx, level + 1);
+
+    for (uint32_t node = dlx->left[row]; node != row; node = dlx->left[node]) {
+      dlx_uncover(dlx, dlx->column[node]);
+    }
+  }
+  dlx_uncover(dlx, column);
+
+  return solutions;
+}
+
+size_t dlx_search(dlx_t *dlx, dlx_solution_t on_solution, void *data) {
+  if (dlx == NULL) {
+    return 0;
+  }
+
+  dlx->on_solution = on_solution;
+  dlx->data = data;
+  dlx->stopped = false;
+  return dlx_search_level(dlx, 0);
+}
+
+dlx_stats_t dlx_stats(const dlx_t *dlx) {
+  dlx_stats_t empty = {0, 0, 0};
+  if (dlx == NULL) {
+    return empty;
+  }
+  return dlx->stats;
+}
@@ -1,13 +1,489 @@
 #include "grid.h"
 
-#include <math.h>
+#include "arena.h"
+
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define GRID_SIMD /* AVX2 and AVX-512 kernels, picked at runtime */
+#endif
+
+#define CACHE_LINE_SIZE 64
+
+/* Undo log entry: a cell and the colors it had before being modified, or a
+ * unit (TRAIL_UNIT set) and the unit flags it had before they changed */
+typedef struct {
+  size_t cell;
+  colors_t colors;
+} trail_entry_t;
+
+#define TRAIL_UNIT ((size_t)1 << (sizeof(size_t) * 8 - 1))
 
 /* Internal structure (hidden from outside for a sudoku grid) */
 struct _grid_t {
   size_t size;
-  colors_t **cells;
+  size_t stride;   /* distance (in cells) between two consecutive rows */
+  void *cells; /* one contiguous, cache-line aligned array of cells */
+  size_t cell_bytes; /* 2, 4 or 8: the narrowest type that holds the colors */
+  const grid_tables_t *tables; /* unit and peer tables shared per size */
+
+  /* Propagation state: dirty units waiting for the heuristics and newly
+   * fixed cells waiting for their color to be removed from their peers */
+  uint16_t *queue;   /* ring buffer of dirty units (units_nb entries) */
+  size_t queue_head;
+  size_t queue_nb;
+  uint16_t *fixed;   /* stack of newly fixed cells (size * size entries) */
+  size_t fixed_nb;
+  uint8_t *queued;   /* units_nb unit flags then size * size 'fixed' flags */
+
+  /* Branching: unsolved cells (two colors or more) are linked in buckets by
+   * number of colors, kept up to date on every cell write */
+  uint16_t *bucket_next;   /* size * size links, then the previous ones */
+  uint16_t *bucket_prev;
+  uint16_t *bucket_of;     /* bucket of each cell, 0 if it is not unsolved */
+  uint16_t *unit_unsolved; /* unsolved cells of each unit */
+  uint16_t bucket_head[MAX_GRID_SIZE + 1];
+  colors_t buckets_used;   /* bit 'n' set if bucket 'n' is not empty */
+
+  /* Trail: previous value of every cell modified since grid_trail_enable,
+   * and of the UNIT_SUBSETS flags (the buffer is kept with the grid in the
+   * pool, disabled) */
+  trail_entry_t *trail;
+  size_t trail_nb;
+  size_t trail_capacity;
+  bool trail_enabled;
+
+  grid_t *next_free; /* next grid in the pool while the grid is not in use */
 };
 
+/* Grids given back by grid_free, one free list per size and per thread */
+static _Thread_local grid_t *grid_pool[MAX_GRID_SIZE + 1];
+
+/* Unit and peer tables, built once per grid size and never released. Threads
+ * racing to build them keep the first tables published. */
+static _Atomic(grid_tables_t *) tables_cache[MAX_GRID_SIZE + 1];
+
+static size_t block_size_of(const size_t size) {
+  size_t block_size = 1;
+  while ((block_size + 1) * (block_size + 1) <= size) {
+    block_size++;
+  }
+  return block_size;
+}
+
+static void tables_free(grid_tables_t *tables) {
+  if (tables == NULL) {
+    return;
+  }
+  free(tables->units);
+  free(tables->peers);
+  free(tables->cell_units);
+  free(tables);
+}
+
+static grid_tables_t *tables_build(const size_t size) {
+  grid_tables_t *tables = calloc(1, sizeof(grid_tables_t));
+  if (tables == NULL) {
+    return NULL;
+  }
+
+  size_t block_size = block_size_of(size);
+  size_t cells_nb = size * size;
+  tables->size = size;
+  tables->block_size = block_size;
+  tables->units_nb = GRID_UNIT_TYPES * size;
+  tables->peers_nb = GRID_UNIT_TYPES * (size - 1) - 2 * (block_size - 1);
+  tables->units = malloc(tables->units_nb * size * sizeof(uint16_t));
+  tables->peers = malloc((cells_nb * tables->peers_nb + 1) * sizeof(uint16_t));
+  tables->cell_units = malloc(cells_nb * GRID_UNIT_TYPES * sizeof(uint16_t));
+  if (tables->units == NULL || tables->peers == NULL ||
+      tables->cell_units == NULL) {
+    tables_free(tables);
+    return NULL;
+  }
+
+  /* Units: rows first, then columns, then blocks (row-major inside) */
+  for (size_t unit = 0; unit < size; unit++) {
+    uint16_t *row = &tables->units[(unit + 0 * size) * size];
+    uint16_t *col = &tables->units[(unit + 1 * size) * size];
+    uint16_t *block = &tables->units[(unit + 2 * size) * size];
+    size_t row_offset = (unit / block_size) * block_size;
+    size_t col_offset = (unit % block_size) * block_size;
+
+    for (size_t index = 0; index < size; index++) {
+      row[index] = unit * size + index;
+      col[index] = index * size + unit;
+      block[index] = (row_offset + index / block_size) * size + col_offset +
+                     index % block_size;
+    }
+  }
+
+  for (size_t unit = 0; unit < tables->units_nb; unit++) {
+    for (size_t index = 0; index < size; index++) {
+      size_t cell = tables->units[unit * size + index];
+      tables->cell_units[cell * GRID_UNIT_TYPES + unit / size] = unit;
+    }
+  }
+
+  /* Peers: every other cell sharing at least one unit, without duplicates */
+  size_t seen[cells_nb];
+  for (size_t cell = 0; cell < cells_nb; cell++) {
+    seen[cell] = cells_nb;
+  }
+
+  for (size_t cell = 0; cell < cells_nb; cell++) {
+    uint16_t *peers = &tables->peers[cell * tables->peers_nb];
+    size_t peers_nb = 0;
+    seen[cell] = cell;
+
+    for (size_t type = 0; type < GRID_UNIT_TYPES; type++) {
+      const uint16_t *unit = grid_tables_unit(
+          tables, tables->cell_units[cell * GRID_UNIT_TYPES + type]);
+      for (size_t index = 0; index < size; index++) {
+        if (seen[unit[index]] != cell) {
+          seen[unit[index]] = cell;
+          peers[peers_nb] = unit[index];
+          peers_nb++;
+        }
+      }
+    }
+  }
+
+  return tables;
+}
+
+const grid_tables_t *grid_tables(const size_t size) {
+  if (!grid_check_size(size)) {
+    return NULL;
+  }
+
+  grid_tables_t *tables = atomic_load(&tables_cache[size]);
+  if (tables == NULL) {
+    grid_tables_t *built = tables_build(size);
+    if (built == NULL) {
+      return NULL;
+    }
+    if (atomic_compare_exchange_strong(&tables_cache[size], &tables, built)) {
+      tables = built;
+    } else {
+      tables_free(built);
+    }
+  }
+  return tables;
+}
+
+/* Cell addressing helpers */
+
+/* Cells are stored on 16 bits up to 16x16 grids and on 32 bits for 25x25
+ * ones, so that copies and the working set of small grids shrink. They are
+ * widened to colors_t when read. */
+static inline size_t grid_cell_bytes_of(const size_t size) {
+  if (size <= 16) {
+    return sizeof(uint16_t);
+  }
+  if (size <= 32) {
+    return sizeof(uint32_t);
+  }
+  return sizeof(colors_t);
+}
+
+static inline size_t grid_cells_bytes(const size_t size) {
+  size_t bytes = size * size * grid_cell_bytes_of(size);
+  return (bytes + CACHE_LINE_SIZE - 1) & ~((size_t)CACHE_LINE_SIZE - 1);
+}
+
+static inline size_t grid_index(const grid_t *grid, const size_t row,
+                                const size_t col) {
+  return row * grid->stride + col;
+}
+
+static inline colors_t grid_cell_get(const grid_t *grid, const size_t cell) {
+  switch (grid->cell_bytes) {
+  case sizeof(uint16_t):
+    return ((const uint16_t *)grid->cells)[cell];
+  case sizeof(uint32_t):
+    return ((const uint32_t *)grid->cells)[cell];
+  default:
+    return ((const colors_t *)grid->cells)[cell];
+  }
+}
+
+static inline void grid_cell_store(grid_t *grid, const size_t cell,
+                                   const colors_t colors) {
+  switch (grid->cell_bytes) {
+  case sizeof(uint16_t):
+    ((uint16_t *)grid->cells)[cell] = (uint16_t)colors;
+    break;
+  case sizeof(uint32_t):
+    ((uint32_t *)grid->cells)[cell] = (uint32_t)colors;
+    break;
+  default:
+    ((colors_t *)grid->cells)[cell] = colors;
+  }
+}
+
+/* Branching buckets helpers */
+
+#define BUCKET_NONE UINT16_MAX
+
+static inline void grid_bucket_unlink(grid_t *grid, const size_t cell) {
+  size_t bucket = grid->bucket_of[cell];
+  uint16_t next = grid->bucket_next[cell];
+  uint16_t prev = grid->bucket_prev[cell];
+  if (prev != BUCKET_NONE) {
+    grid->bucket_next[prev] = next;
+  } else {
+    grid->bucket_head[bucket] = next;
+    if (next == BUCKET_NONE) {
+      grid->buckets_used &= ~colors_set(bucket);
+    }
+  }
+  if (next != BUCKET_NONE) {
+    grid->bucket_prev[next] = prev;
+  }
+}
+
+static inline void grid_bucket_link(grid_t *grid, const size_t cell,
+                                    const size_t bucket) {
+  uint16_t head = grid->bucket_head[bucket];
+  grid->bucket_next[cell] = head;
+  grid->bucket_prev[cell] = BUCKET_NONE;
+  if (head != BUCKET_NONE) {
+    grid->bucket_prev[head] = cell;
+  }
+  grid->bucket_head[bucket] = cell;
+  grid->buckets_used |= colors_set(bucket);
+}
+
+/* Moves a cell to the bucket of its new number of colors, and keeps the
+ * count of unsolved cells of its units */
+static inline void grid_bucket_update(grid_t *grid, const size_t cell,
+                                      const colors_t colors) {
+  size_t count = colors_count(colors);
+  size_t bucket = count >= 2 ? count : 0;
+  size_t previous = grid->bucket_of[cell];
+  if (bucket == previous) {
+    return;
+  }
+
+  if (previous != 0) {
+    grid_bucket_unlink(grid, cell);
+  }
+  grid->bucket_of[cell] = bucket;
+  if (bucket != 0) {
+    grid_bucket_link(grid, cell, bucket);
+  }
+
+  if ((previous == 0) != (bucket == 0)) {
+    const uint16_t *units = &grid->tables->cell_units[cell * GRID_UNIT_TYPES];
+    for (size_t type = 0; type < GRID_UNIT_TYPES; type++) {
+      grid->unit_unsolved[units[type]] += bucket != 0 ? 1 : -1;
+    }
+  }
+}
+
+/* Rebuilds the buckets from the cells */
+static void grid_buckets_build(grid_t *grid) {
+  size_t cells_nb = grid->size * grid->size;
+  for (size_t bucket = 0; bucket <= MAX_GRID_SIZE; bucket++) {
+    grid->bucket_head[bucket] = BUCKET_NONE;
+  }
+  grid->buckets_used = colors_empty();
+  memset(grid->bucket_of, 0, cells_nb * sizeof(uint16_t));
+  memset(grid->unit_unsolved, 0, grid->tables->units_nb * sizeof(uint16_t));
+  for (size_t cell = cells_nb; cell > 0; cell--) {
+    grid_bucket_update(grid, cell - 1, grid_cell_get(grid, cell - 1));
+  }
+}
+
+static inline void grid_cell_put(grid_t *grid, const size_t cell,
+                                 const colors_t colors) {
+  grid_cell_store(grid, cell, colors);
+  grid_bucket_update(grid, cell, colors);
+}
+
+/* Returns the cells of a row as colors_t, widened into 'buffer' if the
+ * cells are narrower */
+static inline const colors_t *grid_row(const grid_t *grid, const size_t row,
+                                       colors_t *buffer) {
+  size_t first = grid_index(grid, row, 0);
+  if (grid->cell_bytes == sizeof(colors_t)) {
+    return &((const colors_t *)grid->cells)[first];
+  }
+  for (size_t col = 0; col < grid->size; col++) {
+    buffer[col] = grid_cell_get(grid, first + col);
+  }
+  return buffer;
+}
+
+/* Trail helpers */
+
+/* Doubles the trail: an entry can't be dropped without corrupting the grid
+ * on the next restore, so running out of memory here aborts */
+static void grid_trail_grow(grid_t *grid) {
+  size_t capacity = 2 * grid->trail_capacity;
+  trail_entry_t *trail = realloc(grid->trail, capacity * sizeof(trail_entry_t));
+  if (trail == NULL) {
+    fputs("grid: out of memory while growing the trail\n", stderr);
+    abort();
+  }
+  alloc_stats_grid(
+      (long)((capacity - grid->trail_capacity) * sizeof(trail_entry_t)));
+  grid->trail = trail;
+  grid->trail_capacity = capacity;
+}
+
+static inline void grid_trail_push(grid_t *grid, const size_t cell,
+                                   const colors_t colors) {
+  if (!grid->trail_enabled) {
+    return;
+  }
+  if (grid->trail_nb == grid->trail_capacity) {
+    grid_trail_grow(grid);
+  }
+  grid->trail[grid->trail_nb].cell = cell;
+  grid->trail[grid->trail_nb].colors = colors;
+  grid->trail_nb++;
+}
+
+/* Colors removed by the writes of the calling thread, the yield of a
+ * heuristic is measured on it */
+static _Thread_local size_t removed_colors;
+
+static inline void grid_cell_write(grid_t *grid, const size_t cell,
+                                   const colors_t colors) {
+  colors_t previous = grid_cell_get(grid, cell);
+  removed_colors += colors_count(colors_subtract(previous, colors));
+  grid_trail_push(grid, cell, previous);
+  grid_cell_put(grid, cell, colors);
+}
+
+/* Propagation queue helpers */
+
+#define UNIT_QUEUED 1  /* waiting in the queue for subgrid_singles */
+#define UNIT_SUBSETS 2 /* modified since subgrid_subsets last saw it */
+
+static inline void grid_unit_enqueue(grid_t *grid, const size_t unit) {
+  uint8_t flags = grid->queued[unit];
+  if (!(flags & UNIT_SUBSETS)) {
+    grid_trail_push(grid, TRAIL_UNIT | unit, flags);
+  }
+  grid->queued[unit] = flags | UNIT_QUEUED | UNIT_SUBSETS;
+  if (flags & UNIT_QUEUED) {
+    return;
+  }
+  size_t units_nb = grid->tables->units_nb;
+  grid->queue[(grid->queue_head + grid->queue_nb) % units_nb] = unit;
+  grid->queue_nb++;
+}
+
+static inline size_t grid_unit_dequeue(grid_t *grid) {
+  size_t unit = grid->queue[grid->queue_head];
+  grid->queued[unit] &= ~UNIT_QUEUED;
+  grid->queue_head = (grid->queue_head + 1) % grid->tables->units_nb;
+  grid->queue_nb--;
+  return unit;
+}
+
+static inline void grid_fixed_push(grid_t *grid, const size_t cell) {
+  uint8_t *fixed = &grid->queued[grid->tables->units_nb + cell];
+  if (*fixed) {
+    return;
+  }
+  *fixed = 1;
+  grid->fixed[grid->fixed_nb] = cell;
+  grid->fixed_nb++;
+}
+
+static inline size_t grid_fixed_pop(grid_t *grid) {
+  grid->fixed_nb--;
+  size_t cell = grid->fixed[grid->fixed_nb];
+  grid->queued[grid->tables->units_nb + cell] = 0;
+  return cell;
+}
+
+/* Drops the pending events. The UNIT_SUBSETS flags stay: a unit the subsets
+ * stage has not seen yet (stage on hold) still has to be looked at, and
+ * grid_trail_restore puts them back as they were at the restore point */
+static void grid_events_clear(grid_t *grid) {
+  while (grid->queue_nb > 0) {
+    grid_unit_dequeue(grid);
+  }
+  while (grid->fixed_nb > 0) {
+    grid_fixed_pop(grid);
+  }
+  grid->queue_head = 0;
+}
+
+/* Records that a cell has just changed: its units become dirty and, if it
+ * is now fixed, its color has to be removed from its peers. Returns false
+ * if the cell has no color left. */
+static inline bool grid_cell_changed(grid_t *grid, const size_t cell) {
+  const uint16_t *units = &grid->tables->cell_units[cell * GRID_UNIT_TYPES];
+  for (size_t type = 0; type < GRID_UNIT_TYPES; type++) {
+    grid_unit_enqueue(grid, units[type]);
+  }
+
+  colors_t color = grid_cell_get(grid, cell);
+  if (color == colors_empty()) {
+    return false;
+  }
+  if (colors_is_singleton(color)) {
+    grid_fixed_push(grid, cell);
+  }
+  return true;
+}
+
+static bool grid_fixed_propagate(grid_t *grid, const size_t cell) {
+  colors_t color = grid_cell_get(grid, cell);
+  if (!colors_is_singleton(color)) {
+    return true;
+  }
+
+  const uint16_t *peers = grid_tables_peers(grid->tables, cell);
+  for (size_t index = 0; index < grid->tables->peers_nb; index++) {
+    colors_t peer = grid_cell_get(grid, peers[index]);
+    if (colors_and(peer, color) != colors_empty()) {
+      grid_cell_write(grid, peers[index], colors_subtract(peer, color));
+      if (!grid_cell_changed(grid, peers[index])) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool grid_unit_propagate(grid_t *grid, const size_t unit) {
+  size_t size = grid->size;
+  const uint16_t *cells = grid_tables_unit(grid->tables, unit);
+  colors_t *subgrid[size];
+  colors_t values[size];
+  colors_t before[size];
+
+  /* The heuristics work on a widened copy of the unit */
+  for (size_t index = 0; index < size; index++) {
+    values[index] = grid_cell_get(grid, cells[index]);
+    before[index] = values[index];
+    subgrid[index] = &values[index];
+  }
+
+  if (!subgrid_singles(subgrid, size)) {
+    return true;
+  }
+
+  bool consistent = true;
+  for (size_t index = 0; index < size; index++) {
+    if (values[index] != before[index]) {
+      grid_cell_write(grid, cells[index], values[index]);
+      consistent &= grid_cell_changed(grid, cells[index]);
+    }
+  }
+  return consistent;
+}
+
 /* Grid functions */
 
 char *grid_get_cell(const grid_t *grid, const size_t row, const size_t column) {
@@ -15,18 +491,16 @@ char *grid_get_cell(const grid_t *grid, const size_t row, const size_t column) {
     return NULL;
   }
 
-  colors_t color = grid->cells[row][column];
+  colors_t color = grid_cell_get(grid, grid_index(grid, row, column));
   char *string = calloc(colors_count(color) + 1, sizeof(char));
   if (string == NULL) {
     return NULL;
   }
 
   int string_index = 0;
-  for (size_t index = 0; index < grid->size; index++) {
-    if (colors_is_in(color, index)) {
-      string[string_index] = color_table[index];
-      string_index++;
-    }
+  while (color != 0) {
+    string[string_index] = color_table[colors_pop(&color)];
+    string_index++;
   }
   return string;
 }
@@ -53,49 +527,227 @@ bool grid_check_size(const size_t size) {
           size == 36 || size == 49 || size == 64);
 }
 
-bool grid_is_consistent(grid_t *grid) {
-  if (grid == NULL) {
-    return false;
+/* Unit checks: the grid is read once, row by row. Each row is reduced
+ * horizontally, while columns and blocks are accumulated lane by lane. A
+ * unit is consistent when none of its cells is empty, all the colors show
+ * up and its singletons are all different (as many singletons as colors in
+ * their union). */
+
+typedef struct {
+  /* Lane accumulators: [0] for the columns, [1] for the current band of
+   * blocks (padded so that full vectors can always be loaded) */
+  _Alignas(CACHE_LINE_SIZE) colors_t all[2][MAX_GRID_SIZE];
+  _Alignas(CACHE_LINE_SIZE) colors_t single[2][MAX_GRID_SIZE];
+  _Alignas(CACHE_LINE_SIZE) colors_t single_nb[2][MAX_GRID_SIZE];
+
+  /* Horizontal reduction of the last row */
+  colors_t row_all;
+  colors_t row_single;
+  size_t row_single_nb;
+} scan_t;
+
+typedef bool (*scan_row_t)(const colors_t *row, const size_t size,
+                           scan_t *scan);
+
+static bool scan_row_scalar(const colors_t *row, const size_t size,
+                            scan_t *scan) {
+  scan->row_all = 0;
+  scan->row_single = 0;
+  scan->row_single_nb = 0;
+  for (size_t col = 0; col < size; col++) {
+    colors_t colors = row[col];
+    if (colors == 0) {
+      return false;
+    }
+    colors_t single = (colors & (colors - 1)) == 0 ? colors : 0;
+    scan->row_all |= colors;
+    scan->row_single |= single;
+    scan->row_single_nb += single != 0;
+    for (size_t acc = 0; acc < 2; acc++) {
+      scan->all[acc][col] |= colors;
+      scan->single[acc][col] |= single;
+      scan->single_nb[acc][col] += single != 0;
+    }
   }
+  return true;
+}
 
-  bool result = true;
-  size_t size = grid_get_size(grid);
-  colors_t subgrid[size];
+#ifdef GRID_SIMD
+__attribute__((target("avx2"))) static bool
+scan_row_avx2(const colors_t *row, const size_t size, scan_t *scan) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi64x(1);
+  const __m256i lanes = _mm256_setr_epi64x(0, 1, 2, 3);
+  __m256i row_all = zero, row_single = zero, row_single_nb = zero;
 
-  /* Rows */
-  for (size_t row = 0; row < size; row++) {
-    for (size_t col = 0; col < size; col++) {
-      subgrid[col] = grid->cells[row][col];
+  for (size_t col = 0; col < size; col += 4) {
+    __m256i active = _mm256_cmpgt_epi64(
+        _mm256_set1_epi64x((long long)(size - col)), lanes);
+    __m256i colors =
+        _mm256_maskload_epi64((const long long *)&row[col], active);
+    __m256i empty = _mm256_cmpeq_epi64(colors, zero);
+    if (_mm256_movemask_pd(_mm256_castsi256_pd(
+            _mm256_and_si256(empty, active))) != 0) {
+      return false;
+    }
+    __m256i is_single = _mm256_andnot_si256(
+        empty, _mm256_cmpeq_epi64(
+                   _mm256_and_si256(colors, _mm256_sub_epi64(colors, one)),
+                   zero));
+    __m256i single = _mm256_and_si256(colors, is_single);
+    __m256i count = _mm256_and_si256(one, is_single);
+    row_all = _mm256_or_si256(row_all, colors);
+    row_single = _mm256_or_si256(row_single, single);
+    row_single_nb = _mm256_add_epi64(row_single_nb, count);
+
+    for (size_t acc = 0; acc < 2; acc++) {
+      __m256i *all = (__m256i *)&scan->all[acc][col];
+      __m256i *singles = (__m256i *)&scan->single[acc][col];
+      __m256i *single_nb = (__m256i *)&scan->single_nb[acc][col];
+      _mm256_storeu_si256(all, _mm256_or_si256(_mm256_loadu_si256(all),
+                                               colors));
+      _mm256_storeu_si256(singles, _mm256_or_si256(
+                                       _mm256_loadu_si256(singles), single));
+      _mm256_storeu_si256(single_nb, _mm256_add_epi64(
+                                         _mm256_loadu_si256(single_nb),
+                                         count));
     }
-    result &= subgrid_consistency(subgrid, size);
   }
 
-  /* Columns */
-  for (size_t col = 0; col < size; col++) {
-    for (size_t row = 0; row < size; row++) {
-      subgrid[row] = grid->cells[row][col];
+  colors_t reduce[3][4];
+  _mm256_storeu_si256((__m256i *)reduce[0], row_all);
+  _mm256_storeu_si256((__m256i *)reduce[1], row_single);
+  _mm256_storeu_si256((__m256i *)reduce[2], row_single_nb);
+  scan->row_all = reduce[0][0] | reduce[0][1] | reduce[0][2] | reduce[0][3];
+  scan->row_single =
+      reduce[1][0] | reduce[1][1] | reduce[1][2] | reduce[1][3];
+  scan->row_single_nb =
+      reduce[2][0] + reduce[2][1] + reduce[2][2] + reduce[2][3];
+  return true;
+}
+
+__attribute__((target("avx512f"))) static bool
+scan_row_avx512(const colors_t *row, const size_t size, scan_t *scan) {
+  const __m512i zero = _mm512_setzero_si512();
+  const __m512i one = _mm512_set1_epi64(1);
+  __m512i row_all = zero, row_single = zero, row_single_nb = zero;
+
+  /* A row of a 64x64 grid is exactly 8 vectors */
+  for (size_t col = 0; col < size; col += 8) {
+    __mmask8 active =
+        size - col >= 8 ? 0xFF : (__mmask8)((1U << (size - col)) - 1);
+    __m512i colors = _mm512_maskz_loadu_epi64(active, &row[col]);
+    if (_mm512_mask_cmpeq_epi64_mask(active, colors, zero) != 0) {
+      return false;
+    }
+    __mmask8 is_single = _mm512_mask_testn_epi64_mask(
+        active, colors, _mm512_sub_epi64(colors, one));
+    __m512i single = _mm512_maskz_mov_epi64(is_single, colors);
+    __m512i count = _mm512_maskz_mov_epi64(is_single, one);
+    row_all = _mm512_or_si512(row_all, colors);
+    row_single = _mm512_or_si512(row_single, single);
+    row_single_nb = _mm512_add_epi64(row_single_nb, count);
+
+    for (size_t acc = 0; acc < 2; acc++) {
+      colors_t *all = &scan->all[acc][col];
+      colors_t *singles = &scan->single[acc][col];
+      colors_t *single_nb = &scan->single_nb[acc][col];
+      _mm512_store_si512(all, _mm512_or_si512(_mm512_load_si512(all),
+                                              colors));
+      _mm512_store_si512(singles, _mm512_or_si512(
+                                      _mm512_load_si512(singles), single));
+      _mm512_store_si512(single_nb, _mm512_add_epi64(
+                                        _mm512_load_si512(single_nb), count));
     }
-    result &= subgrid_consistency(subgrid, size);
   }
 
-  /* Blocks */
-  size_t block_size = sqrt(size);
+  scan->row_all = _mm512_reduce_or_epi64(row_all);
+  scan->row_single = _mm512_reduce_or_epi64(row_single);
+  scan->row_single_nb = _mm512_reduce_add_epi64(row_single_nb);
+  return true;
+}
+#endif
 
-  for (size_t block_number = 0; block_number < size; block_number++) {
+static scan_row_t scan_row_kernel(void) {
+#ifdef GRID_SIMD
+  if (__builtin_cpu_supports("avx512f")) {
+    return scan_row_avx512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return scan_row_avx2;
+  }
+#endif
+  return scan_row_scalar;
+}
 
-    size_t index = 0;
-    size_t row_offset = (block_number / block_size) * block_size;
-    size_t col_offset = (block_number % block_size) * block_size;
+static bool unit_is_consistent(const colors_t all, const colors_t single,
+                               const size_t single_nb, const colors_t full) {
+  return all == full && colors_count(single) == single_nb;
+}
 
-    for (size_t row = 0; row < block_size; row++) {
-      for (size_t col = 0; col < block_size; col++) {
-        subgrid[index] = grid->cells[row + row_offset][col + col_offset];
-        index++;
+/* Checks every unit of the grid in one pass, 'solved' tells whether all the
+ * cells are singletons (only meaningful if the grid is consistent) */
+static bool grid_scan(const grid_t *grid, bool *solved) {
+  size_t size = grid->size;
+  size_t block_size = grid->tables->block_size;
+  colors_t full = colors_full(size);
+  scan_row_t scan_row = scan_row_kernel();
+  scan_t scan;
+  _Alignas(CACHE_LINE_SIZE) colors_t buffer[MAX_GRID_SIZE];
+  size_t singles_nb = 0;
+
+  memset(scan.all[0], 0, sizeof(scan.all[0]));
+  memset(scan.single[0], 0, sizeof(scan.single[0]));
+  memset(scan.single_nb[0], 0, sizeof(scan.single_nb[0]));
+  for (size_t row = 0; row < size; row++) {
+    if (row % block_size == 0) {
+      memset(scan.all[1], 0, sizeof(scan.all[1]));
+      memset(scan.single[1], 0, sizeof(scan.single[1]));
+      memset(scan.single_nb[1], 0, sizeof(scan.single_nb[1]));
+    }
+
+    if (!scan_row(grid_row(grid, row, buffer), size, &scan) ||
+        !unit_is_consistent(scan.row_all, scan.row_single,
+                            scan.row_single_nb, full)) {
+      return false;
+    }
+    singles_nb += scan.row_single_nb;
+
+    /* End of a band: blocks are reduced over their columns */
+    if (row % block_size == block_size - 1) {
+      for (size_t block_col = 0; block_col < size; block_col += block_size) {
+        colors_t all = 0, single = 0;
+        size_t single_nb = 0;
+        for (size_t col = block_col; col < block_col + block_size; col++) {
+          all |= scan.all[1][col];
+          single |= scan.single[1][col];
+          single_nb += scan.single_nb[1][col];
+        }
+        if (!unit_is_consistent(all, single, single_nb, full)) {
+          return false;
+        }
       }
     }
-    result &= subgrid_consistency(subgrid, size);
   }
-  return result;
+
+  for (size_t col = 0; col < size; col++) {
+    if (!unit_is_consistent(scan.all[0][col], scan.single[0][col],
+                            scan.single_nb[0][col], full)) {
+      return false;
+    }
+  }
+
+  *solved = singles_nb == size * size;
+  return true;
+}
+
+bool grid_is_consistent(grid_t *grid) {
+  if (grid == NULL) {
+    return false;
+  }
+
+  bool solved;
+  return grid_scan(grid, &solved);
 }
 
 bool grid_is_solved(grid_t *grid) {
@@ -103,9 +755,11 @@ bool grid_is_solved(grid_t *grid) {
     return false;
   }
 
+  colors_t buffer[MAX_GRID_SIZE];
   for (size_t row = 0; row < grid->size; row++) {
+    const colors_t *cells = grid_row(grid, row, buffer);
     for (size_t col = 0; col < grid->size; col++) {
-      if (!colors_is_singleton(grid->cells[row][col])) {
+      if (!colors_is_singleton(cells[col])) {
         return false;
       }
     }
@@ -122,75 +776,126 @@ bool subgrid_apply(grid_t *grid,
   }
 
   bool result = false;
-  size_t size = grid_get_size(grid);
+  size_t size = grid->size;
+  const grid_tables_t *tables = grid->tables;
   colors_t *subgrid[size];
+  colors_t values[size];
 
-  /* Rows */
-  for (size_t row = 0; row < size; row++) {
-    for (size_t col = 0; col < size; col++) {
-      subgrid[col] = &(grid->cells[row][col]);
+  for (size_t unit = 0; unit < tables->units_nb; unit++) {
+    const uint16_t *cells = grid_tables_unit(tables, unit);
+    for (size_t index = 0; index < size; index++) {
+      values[index] = grid_cell_get(grid, cells[index]);
+      subgrid[index] = &values[index];
     }
-
     result |= func(subgrid, size);
+    for (size_t index = 0; index < size; index++) {
+      grid_cell_put(grid, cells[index], values[index]);
+    }
   }
 
-  /* Columns */
-  for (size_t col = 0; col < size; col++) {
-    for (size_t row = 0; row < size; row++) {
-      subgrid[row] = &(grid->cells[row][col]);
-    }
+  return result;
+}
 
-    result |= func(subgrid, size);
+/* Memory held by a grid, trail included */
+static long grid_footprint(const grid_t *grid) {
+  size_t size = grid->size;
+  size_t events_nb = grid->tables->units_nb + size * size;
+  size_t bytes = sizeof(grid_t) + grid_cells_bytes(size) +
+                 events_nb * (sizeof(uint16_t) + sizeof(uint8_t)) +
+                 (3 * size * size + grid->tables->units_nb) * sizeof(uint16_t);
+  if (grid->trail != NULL) {
+    bytes += grid->trail_capacity * sizeof(trail_entry_t);
   }
+  return (long)bytes;
+}
 
-  /* Blocks */
-  size_t block_size = sqrt(size);
-  for (size_t block_number = 0; block_number < size; block_number++) {
+/* Heap buffers of a grid, trail apart: the grid itself, its cells, queue,
+ * queued flags and bucket links (see grid_take and grid_pool_release) */
+#define GRID_HEAP_BUFFERS 5
 
-    size_t index = 0;
-    size_t row_offset = (block_number / block_size) * block_size;
-    size_t col_offset = (block_number % block_size) * block_size;
+/* Takes a grid out of the pool, or builds a new one from the heap */
+static grid_t *grid_take(const grid_tables_t *tables) {
+  size_t size = tables->size;
+  grid_t *grid = grid_pool[size];
+  if (grid != NULL) {
+    grid_pool[size] = grid->next_free;
+    alloc_stats_pool_hit();
+    return grid;
+  }
 
-    for (size_t row = 0; row < block_size; row++) {
-      for (size_t col = 0; col < block_size; col++) {
-        subgrid[index] = &(grid->cells[row + row_offset][col + col_offset]);
-        index++;
-      }
-    }
-    result |= func(subgrid, size);
+  grid = malloc(sizeof(grid_t));
+  if (grid == NULL) {
+    return NULL;
   }
 
-  return result;
+  size_t events_nb = tables->units_nb + size * size;
+  grid->cells = aligned_alloc(CACHE_LINE_SIZE, grid_cells_bytes(size));
+  grid->queue = malloc(events_nb * sizeof(uint16_t));
+  grid->queued = calloc(events_nb, sizeof(uint8_t));
+  grid->bucket_next =
+      malloc((3 * size * size + tables->units_nb) * sizeof(uint16_t));
+  if (grid->cells == NULL || grid->queue == NULL || grid->queued == NULL ||
+      grid->bucket_next == NULL) {
+    free(grid->cells);
+    free(grid->queue);
+    free(grid->queued);
+    free(grid->bucket_next);
+    free(grid);
+    return NULL;
+  }
+  grid->bucket_prev = &grid->bucket_next[size * size];
+  grid->bucket_of = &grid->bucket_prev[size * size];
+  grid->unit_unsolved = &grid->bucket_of[size * size];
+  alloc_stats_heap(GRID_HEAP_BUFFERS);
+
+  grid->trail = NULL;
+  grid->trail_capacity = 0;
+  return grid;
 }
 
-grid_t *grid_alloc(size_t size) {
-  if (!grid_check_size(size)) {
+/* Takes a grid and resets its state, leaving its cells undefined */
+static grid_t *grid_init(const size_t size) {
+  const grid_tables_t *tables = grid_tables(size);
+  if (tables == NULL) {
     return NULL;
   }
 
-  grid_t *grid = malloc(sizeof(grid_t));
+  grid_t *grid = grid_take(tables);
   if (grid == NULL) {
     return NULL;
   }
 
-  grid->cells = malloc(size * sizeof(colors_t *));
-  if (grid->cells == NULL) {
-    free(grid);
+  grid->size = size;
+  grid->stride = size;
+  grid->cell_bytes = grid_cell_bytes_of(size);
+  grid->tables = tables;
+  grid->fixed = &grid->queue[tables->units_nb];
+  grid->fixed_nb = 0;
+  grid->trail_nb = 0;
+  grid->trail_enabled = false;
+  grid->queue_head = 0;
+  grid->queue_nb = 0;
+  grid->next_free = NULL;
+  alloc_stats_grid(grid_footprint(grid));
+
+  /* A fresh grid has never been looked at: every unit is dirty */
+  for (size_t unit = 0; unit < tables->units_nb; unit++) {
+    grid_unit_enqueue(grid, unit);
+  }
+  return grid;
+}
+
+grid_t *grid_alloc(size_t size) {
+  grid_t *grid = grid_init(size);
+  if (grid == NULL) {
     return NULL;
   }
 
-  for (size_t index = 0; index < size; index++) {
-    grid->cells[index] = malloc(size * sizeof(colors_t));
-    if (grid->cells[index] == NULL) {
-      for (size_t de_alloc_ind = 0; de_alloc_ind < index; de_alloc_ind++) {
-        free(grid->cells[de_alloc_ind]);
-      }
-      free(grid->cells);
-      free(grid);
-      return NULL;
-    }
+  colors_t full = colors_full(size);
+  for (size_t cell = 0; cell < size * size; cell++) {
+    grid_cell_store(grid, cell, full);
   }
-  grid->size = size;
+  grid_buckets_build(grid);
   return grid;
 }
 
@@ -200,17 +905,29 @@ grid_t *grid_copy(const grid_t *grid) {
   }
 
   size_t size = grid->size;
-  grid_t *copy = grid_alloc(size);
+  grid_t *copy = grid_init(size);
   if (copy == NULL) {
     return NULL;
   }
-  for (size_t row = 0; row < size; row++) {
-    for (size_t col = 0; col < size; col++) {
-      copy->cells[row][col] = grid->cells[row][col];
-    }
-  }
+  memcpy(copy->cells, grid->cells, grid_cells_bytes(size));
+  memcpy(copy->bucket_next, grid->bucket_next,
+         (3 * size * size + grid->tables->units_nb) * sizeof(uint16_t));
+  memcpy(copy->bucket_head, grid->bucket_head, sizeof(grid->bucket_head));
+  copy->buckets_used = grid->buckets_used;
 
-  copy->size = size;
+  /* Propagated grids have no pending events, so this is usually skipped
+   * (units left for subgrid_subsets are still flagged) */
+  if (grid->queue_nb > 0 || grid->fixed_nb > 0) {
+    size_t events_nb = grid->tables->units_nb + size * size;
+    memcpy(copy->queue, grid->queue, events_nb * sizeof(uint16_t));
+    memcpy(copy->queued, grid->queued, events_nb * sizeof(uint8_t));
+  } else {
+    memcpy(copy->queued, grid->queued,
+           grid->tables->units_nb * sizeof(uint8_t));
+  }
+  copy->queue_head = grid->queue_head;
+  copy->queue_nb = grid->queue_nb;
+  copy->fixed_nb = grid->fixed_nb;
   return copy;
 }
 
@@ -225,12 +942,30 @@ void grid_free(grid_t *grid) {
   if (grid == NULL) {
     return;
   }
-  if (grid != NULL) {
-    for (size_t index = 0; index < grid->size; index++) {
-      free(grid->cells[index]);
+
+  /* Recycled grids must come back with no pending event */
+  grid_events_clear(grid);
+  alloc_stats_grid(-grid_footprint(grid));
+  grid->next_free = grid_pool[grid->size];
+  grid_pool[grid->size] = grid;
+}
+
+void grid_pool_release(void) {
+  for (size_t size = 0; size <= MAX_GRID_SIZE; size++) {
+    while (grid_pool[size] != NULL) {
+      grid_t *grid = grid_pool[size];
+      grid_pool[size] = grid->next_free;
+      free(grid->cells);
+      free(grid->queue);
+      free(grid->queued);
+      free(grid->bucket_next);
+      alloc_stats_heap(-GRID_HEAP_BUFFERS);
+      if (grid->trail != NULL) {
+        free(grid->trail);
+        alloc_stats_heap(-1);
+      }
+      free(grid);
     }
-    free(grid->cells);
-    free(grid);
   }
 }
 
@@ -239,15 +974,16 @@ void grid_print(const grid_t *grid, FILE *fd) {
     return;
   }
 
+  colors_t buffer[MAX_GRID_SIZE];
   for (size_t row = 0; row < grid->size; row++) {
+    const colors_t *cells = grid_row(grid, row, buffer);
     for (size_t col = 0; col < grid->size; col++) {
-      if (colors_is_singleton(grid->cells[row][col])) {
-        char *string = grid_get_cell(grid, row, col);
-        fprintf(fd, "%s ", string);
-        free(string);
+      if (colors_is_singleton(cells[col])) {
+        fputc(color_table[colors_index(cells[col])], fd);
       } else {
-        fprintf(fd, "_ ");
+        fputc(EMPTY_CELL, fd);
       }
+      fputc(' ', fd);
     }
     fputc('\n', fd);
   }
@@ -260,13 +996,441 @@ void grid_set_cell(grid_t *grid, const size_t row, const size_t column,
     return;
   }
 
+  size_t cell = row * grid->stride + column;
+  colors_t colors = colors_full(grid->size);
   for (size_t index = 0; index <= grid->size; index++) {
     if (color_table[index] == color) {
-      grid->cells[row][column] = 1ULL << index;
-      return;
+      colors = 1ULL << index;
+      break;
+    }
+  }
+  grid_cell_write(grid, cell, colors);
+  grid_cell_changed(grid, cell);
+}
+
+status_t grid_propagate(grid_t *grid) {
+  if (grid == NULL) {
+    return grid_inconsistent;
+  }
+
+  while (grid->fixed_nb > 0 || grid->queue_nb > 0) {
+    bool consistent = grid->fixed_nb > 0
+                          ? grid_fixed_propagate(grid, grid_fixed_pop(grid))
+                          : grid_unit_propagate(grid, grid_unit_dequeue(grid));
+    if (!consistent) {
+      grid_events_clear(grid);
+      return grid_inconsistent;
+    }
+  }
+  return grid_unsolved;
+}
+
+/* Runs subgrid_subsets on the units modified since it last saw them,
+ * 'changed' tells if a color was removed. Returns false if a cell runs out
+ * of colors. */
+static bool grid_subsets(grid_t *grid, bool *changed) {
+  size_t size = grid->size;
+  colors_t *subgrid[size];
+  colors_t values[size];
+  colors_t before[size];
+
+  for (size_t unit = 0; unit < grid->tables->units_nb; unit++) {
+    if (!(grid->queued[unit] & UNIT_SUBSETS)) {
+      continue;
+    }
+    const uint16_t *cells = grid_tables_unit(grid->tables, unit);
+    for (size_t index = 0; index < size; index++) {
+      values[index] = grid_cell_get(grid, cells[index]);
+      before[index] = values[index];
+      subgrid[index] = &values[index];
+    }
+
+    bool consistent = true;
+    if (subgrid_subsets(subgrid, size)) {
+      *changed = true;
+      for (size_t index = 0; index < size; index++) {
+        if (values[index] != before[index]) {
+          grid_cell_write(grid, cells[index], values[index]);
+          consistent &= grid_cell_changed(grid, cells[index]);
+        }
+      }
+    }
+    grid_trail_push(grid, TRAIL_UNIT | unit, grid->queued[unit]);
+    grid->queued[unit] &= ~UNIT_SUBSETS; /* the unit is a fixpoint now */
+    if (!consistent) {
+      grid_events_clear(grid);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Locked candidates: where a block crosses a line (row or column), a color
+ * of the block found only in the intersection cannot be elsewhere on the
+ * line (pointing), and a color of the line found only in the intersection
+ * cannot be elsewhere in the block (claiming). A band (or stack) of blocks
+ * is handled at once from the unions of its intersections. */
+
+static inline size_t grid_line_cell(const grid_t *grid, const bool columns,
+                                    const size_t line, const size_t pos) {
+  return columns ? grid_index(grid, pos, line) : grid_index(grid, line, pos);
+}
+
+/* Removes 'colors' from a cell, returns false if the cell gets empty */
+static inline bool grid_cell_eliminate(grid_t *grid, const size_t cell,
+                                       const colors_t colors, bool *changed) {
+  colors_t current = grid_cell_get(grid, cell);
+  if (colors_and(current, colors) == colors_empty()) {
+    return true;
+  }
+  grid_cell_write(grid, cell, colors_subtract(current, colors));
+  *changed = true;
+  return grid_cell_changed(grid, cell);
+}
+
+static bool grid_locked_band(grid_t *grid, const bool columns,
+                             const size_t first_line, bool *changed) {
+  size_t size = grid->size;
+  size_t block_size = grid->tables->block_size;
+  colors_t inter[block_size][block_size]; /* [line in band][block] */
+
+  for (size_t line = 0; line < block_size; line++) {
+    for (size_t block = 0; block < block_size; block++) {
+      inter[line][block] = colors_empty();
+      for (size_t pos = block * block_size; pos < (block + 1) * block_size;
+           pos++) {
+        inter[line][block] |=
+            grid_cell_get(grid, grid_line_cell(grid, columns,
+                                               first_line + line, pos));
+      }
+    }
+  }
+
+  for (size_t line = 0; line < block_size; line++) {
+    for (size_t block = 0; block < block_size; block++) {
+      colors_t line_rest = colors_empty(), block_rest = colors_empty();
+      for (size_t other = 0; other < block_size; other++) {
+        if (other != block) {
+          line_rest |= inter[line][other];
+        }
+        if (other != line) {
+          block_rest |= inter[other][block];
+        }
+      }
+
+      colors_t pointing = colors_subtract(inter[line][block], block_rest);
+      if (colors_and(pointing, line_rest) != colors_empty()) {
+        for (size_t pos = 0; pos < size; pos++) {
+          if (pos / block_size != block &&
+              !grid_cell_eliminate(
+                  grid, grid_line_cell(grid, columns, first_line + line, pos),
+                  pointing, changed)) {
+            return false;
+          }
+        }
+      }
+
+      colors_t claiming = colors_subtract(inter[line][block], line_rest);
+      if (colors_and(claiming, block_rest) != colors_empty()) {
+        for (size_t other = 0; other < block_size; other++) {
+          if (other == line) {
+            continue;
+          }
+          for (size_t pos = block * block_size; pos < (block + 1) * block_size;
+               pos++) {
+            if (!grid_cell_eliminate(
+                    grid, grid_line_cell(grid, columns, first_line + other, pos),
+                    claiming, changed)) {
+              return false;
+            }
+          }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+/* Runs the locked candidates on every band and stack, 'changed' tells if a
+ * color was removed. Returns false if a cell runs out of colors. */
+static bool grid_locked_candidates(grid_t *grid, bool *changed) {
+  size_t block_size = grid->tables->block_size;
+  for (size_t first_line = 0; first_line < grid->size;
+       first_line += block_size) {
+    if (!grid_locked_band(grid, false, first_line, changed) ||
+        !grid_locked_band(grid, true, first_line, changed)) {
+      grid_events_clear(grid);
+      return false;
+    }
+  }
+  return true;
+}
+
+/* Fish: for one color, if k lines (rows or columns) hold it only within the
+ * same k crossing lines, each of these crossing lines gets the color from
+ * one of the k lines, and loses it everywhere else. Lines are bitmasks of
+ * their candidate cells, so sets of lines are grown while the popcount of
+ * their union stays within k. The enumeration is bounded by a budget, as
+ * sets of 4 lines among 64 are too many to try on every node. */
+
+#define FISH_BUDGET 4096 /* sets of lines enumerated per color and direction */
+
+static size_t fish_max_order = 0;
+static _Thread_local fish_stats_t fish_stats;
+
+typedef struct {
+  const colors_t *lines;   /* candidate cells of the color, per line */
+  const colors_t *crosses; /* the same, per crossing line */
+  size_t lines_nb;
+  size_t order;
+  size_t budget;
+} fish_t;
+
+/* Removes the color from the crossing lines of 'cover', out of the lines of
+ * 'chosen'. Returns false if a cell runs out of colors. */
+static bool grid_fish_eliminate(grid_t *grid, const fish_t *fish,
+                                const bool columns, const size_t color,
+                                const colors_t chosen, colors_t cover,
+                                bool *changed) {
+  bool eliminated = false;
+  while (cover != colors_empty()) {
+    size_t cross = colors_pop(&cover);
+    colors_t others = colors_subtract(fish->crosses[cross], chosen);
+    while (others != colors_empty()) {
+      size_t line = colors_pop(&others);
+      size_t cell = columns ? grid_index(grid, cross, line)
+                            : grid_index(grid, line, cross);
+      bool removed = false;
+      if (!grid_cell_eliminate(grid, cell, colors_set(color), &removed)) {
+        return false;
+      }
+      if (removed) {
+        eliminated = true;
+        *changed = true;
+        fish_stats.eliminations++;
+      }
+    }
+  }
+  if (eliminated) {
+    fish_stats.found[fish->order]++;
+  }
+  return true;
+}
+
+static bool grid_fish_search(grid_t *grid, fish_t *fish, const bool columns,
+                             const size_t color, const size_t first,
+                             const size_t depth, const colors_t chosen,
+                             const colors_t cover, bool *changed) {
+  if (depth == fish->order) {
+    if (colors_count(cover) < fish->order) {
+      return false; /* k lines sharing fewer than k places for the color */
+    }
+    return grid_fish_eliminate(grid, fish, columns, color, chosen, cover,
+                               changed);
+  }
+
+  for (size_t line = first; line < fish->lines_nb && fish->budget > 0;
+       line++) {
+    size_t count = colors_count(fish->lines[line]);
+    colors_t wider = colors_or(cover, fish->lines[line]);
+    if (count < 2 || count > fish->order ||
+        colors_count(wider) > fish->order) {
+      continue;
+    }
+    fish->budget--;
+    fish_stats.combinations++;
+    if (!grid_fish_search(grid, fish, columns, color, line + 1, depth + 1,
+                          colors_add(chosen, line), wider, changed)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool grid_fish(grid_t *grid, bool *changed) {
+  size_t size = grid->size;
+  colors_t rows[size][size]; /* [color][row]: columns holding the color */
+  colors_t cols[size][size]; /* [color][col]: rows holding the color */
+  memset(rows, 0, sizeof(rows));
+  memset(cols, 0, sizeof(cols));
+
+  for (size_t row = 0; row < size; row++) {
+    for (size_t col = 0; col < size; col++) {
+      colors_t colors = grid_cell_get(grid, grid_index(grid, row, col));
+      if (colors_is_singleton(colors)) {
+        continue;
+      }
+      while (colors != colors_empty()) {
+        size_t color = colors_pop(&colors);
+        rows[color][row] = colors_add(rows[color][row], col);
+        cols[color][col] = colors_add(cols[color][col], row);
+      }
+    }
+  }
+
+  fish_stats.calls++;
+  for (size_t color = 0; color < size; color++) {
+    for (size_t order = 2; order <= fish_max_order; order++) {
+      fish_t by_rows = {rows[color], cols[color], size, order, FISH_BUDGET};
+      fish_t by_cols = {cols[color], rows[color], size, order, FISH_BUDGET};
+      if (!grid_fish_search(grid, &by_rows, false, color, 0, 0,
+                            colors_empty(), colors_empty(), changed) ||
+          !grid_fish_search(grid, &by_cols, true, color, 0, 0,
+                            colors_empty(), colors_empty(), changed)) {
+        grid_events_clear(grid);
+        return false;
+      }
+      fish_stats.exhausted += (by_rows.budget == 0) + (by_cols.budget == 0);
+    }
+  }
+  return true;
+}
+
+void grid_fish_enable(const size_t max_order) {
+  fish_max_order =
+      max_order > GRID_FISH_MAX_ORDER ? GRID_FISH_MAX_ORDER : max_order;
+}
+
+fish_stats_t grid_fish_stats(void) {
+  return fish_stats;
+}
+
+void grid_fish_stats_add(const fish_stats_t stats) {
+  fish_stats.calls += stats.calls;
+  fish_stats.combinations += stats.combinations;
+  for (size_t order = 0; order <= GRID_FISH_MAX_ORDER; order++) {
+    fish_stats.found[order] += stats.found[order];
+  }
+  fish_stats.eliminations += stats.eliminations;
+  fish_stats.exhausted += stats.exhausted;
+}
+
+void grid_fish_stats_reset(void) {
+  memset(&fish_stats, 0, sizeof(fish_stats));
+}
+
+/* Scheduler: the stages of grid_heuristics run in pipeline order, and a
+ * stage that removes a color sends the grid back to the first one, so that
+ * cheap stages reach a fixpoint before the expensive ones run again. In
+ * adaptive mode, a stage costlier than the singles that removed nothing
+ * during a call sits out the next 1, 2, 4, ... calls (up to
+ * SCHEDULE_BACKOFF_MAX), which keeps it near the root of the search where
+ * it pays off. Skipped stages make for bigger search trees, so on the
+ * challenge grids the fixed pipeline is still the faster default. */
+
+#define SCHEDULE_BACKOFF_MAX 8 /* calls skipped at most in a row */
+
+static const char *heuristic_names[GRID_HEURISTICS_NB] = {
+    "singles", "locked", "subsets", "fish"};
+
+static heuristic_t pipeline[GRID_HEURISTICS_NB] = {
+    heuristic_singles, heuristic_locked, heuristic_subsets, heuristic_fish};
+static size_t pipeline_nb = GRID_HEURISTICS_NB;
+static bool pipeline_adaptive = false;
+
+typedef struct {
+  heuristic_stats_t stats[GRID_HEURISTICS_NB];
+  size_t backoff[GRID_HEURISTICS_NB]; /* calls to skip after a dry call */
+  size_t wait[GRID_HEURISTICS_NB];    /* calls left to skip */
+} schedule_t;
+
+static _Thread_local schedule_t schedule;
+
+static inline uint64_t schedule_clock(void) {
+  struct timespec now;
+  timespec_get(&now, TIME_UTC);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/* Runs one stage, returns false if the grid is inconsistent */
+static bool schedule_run(grid_t *grid, const heuristic_t heuristic,
+                         bool *changed) {
+  heuristic_stats_t *stats = &schedule.stats[heuristic];
+  size_t removed = removed_colors;
+  uint64_t start = schedule_clock();
+  bool consistent = true;
+  switch (heuristic) {
+  case heuristic_singles:
+    consistent = grid_propagate(grid) != grid_inconsistent;
+    break;
+  case heuristic_locked:
+    consistent = grid_locked_candidates(grid, changed);
+    break;
+  case heuristic_subsets:
+    consistent = grid_subsets(grid, changed);
+    break;
+  case heuristic_fish:
+    consistent = grid_fish(grid, changed);
+    break;
+  }
+  stats->nanoseconds += schedule_clock() - start;
+  stats->runs++;
+  stats->eliminations += removed_colors - removed;
+  return consistent;
+}
+
+bool grid_pipeline_set(const heuristic_t stages[], const size_t stages_nb,
+                       const bool adaptive) {
+  if (stages == NULL || stages_nb == 0 || stages_nb > GRID_HEURISTICS_NB ||
+      stages[0] != heuristic_singles) {
+    return false;
+  }
+  for (size_t stage = 0; stage < stages_nb; stage++) {
+    if (stages[stage] >= GRID_HEURISTICS_NB) {
+      return false;
+    }
+    for (size_t other = 0; other < stage; other++) {
+      if (stages[other] == stages[stage]) {
+        return false;
+      }
     }
   }
-  grid->cells[row][column] = colors_full(grid->size);
+
+  memcpy(pipeline, stages, stages_nb * sizeof(heuristic_t));
+  pipeline_nb = stages_nb;
+  pipeline_adaptive = adaptive;
+  return true;
+}
+
+const char *grid_heuristic_name(const heuristic_t heuristic) {
+  if (heuristic >= GRID_HEURISTICS_NB) {
+    return NULL;
+  }
+  return heuristic_names[heuristic];
+}
+
+bool grid_pipeline_is_adaptive(void) {
+  return pipeline_adaptive;
+}
+
+size_t grid_pipeline_get(heuristic_t stages[GRID_HEURISTICS_NB]) {
+  memcpy(stages, pipeline, pipeline_nb * sizeof(heuristic_t));
+  return pipeline_nb;
+}
+
+heuristic_stats_t grid_heuristic_stats(const heuristic_t heuristic) {
+  heuristic_stats_t empty = {0};
+  if (heuristic >= GRID_HEURISTICS_NB) {
+    return empty;
+  }
+  return schedule.stats[heuristic];
+}
+
+void grid_heuristic_stats_add(const heuristic_t heuristic,
+                              const heuristic_stats_t stats) {
+  if (heuristic >= GRID_HEURISTICS_NB) {
+    return;
+  }
+  heuristic_stats_t *total = &schedule.stats[heuristic];
+  total->runs += stats.runs;
+  total->skips += stats.skips;
+  total->backoffs += stats.backoffs;
+  total->eliminations += stats.eliminations;
+  total->nanoseconds += stats.nanoseconds;
+}
+
+void grid_heuristic_stats_reset(void) {
+  memset(&schedule, 0, sizeof(schedule));
 }
 
 status_t grid_heuristics(grid_t *grid) {
@@ -274,16 +1438,121 @@ status_t grid_heuristics(grid_t *grid) {
     return grid_inconsistent;
   }
 
-  while (subgrid_apply(grid, subgrid_heuristics))
-    ;
+  /* Stages sitting out this call */
+  bool skipped[GRID_HEURISTICS_NB] = {false};
+  size_t removed[GRID_HEURISTICS_NB] = {0};
+  for (size_t stage = 0; stage < pipeline_nb; stage++) {
+    heuristic_t heuristic = pipeline[stage];
+    if (heuristic == heuristic_fish && fish_max_order < 2) {
+      skipped[stage] = true;
+    } else if (pipeline_adaptive && schedule.wait[heuristic] > 0) {
+      schedule.wait[heuristic]--;
+      schedule.stats[heuristic].skips++;
+      skipped[stage] = true;
+    }
+  }
+
+  bool consistent = true;
+  size_t stage = 0;
+  while (consistent && stage < pipeline_nb) {
+    if (skipped[stage]) {
+      stage++;
+      continue;
+    }
+    bool changed = false;
+    size_t before = removed_colors;
+    consistent = schedule_run(grid, pipeline[stage], &changed);
+    removed[stage] += removed_colors - before + !consistent;
+    stage = changed && stage > 0 ? 0 : stage + 1;
+  }
 
-  if (!grid_is_consistent(grid)) {
+  /* Back off the stages that removed nothing (finding a contradiction
+   * counts as a yield) */
+  for (stage = 1; pipeline_adaptive && stage < pipeline_nb; stage++) {
+    heuristic_t heuristic = pipeline[stage];
+    if (skipped[stage]) {
+      continue;
+    }
+    if (removed[stage] > 0) {
+      schedule.backoff[heuristic] = 0;
+      continue;
+    }
+    /* Stages cheaper than the propagation are not worth skipping */
+    heuristic_stats_t *stats = &schedule.stats[heuristic];
+    heuristic_stats_t *singles = &schedule.stats[heuristic_singles];
+    if (stats->nanoseconds * singles->runs <
+        singles->nanoseconds * stats->runs) {
+      continue;
+    }
+    size_t backoff = schedule.backoff[heuristic];
+    backoff = backoff == 0 ? 1 : 2 * backoff;
+    schedule.backoff[heuristic] =
+        backoff > SCHEDULE_BACKOFF_MAX ? SCHEDULE_BACKOFF_MAX : backoff;
+    schedule.wait[heuristic] = schedule.backoff[heuristic];
+    schedule.stats[heuristic].backoffs++;
+  }
+  if (!consistent) {
     return grid_inconsistent;
   }
-  if (grid_is_solved(grid)) {
-    return grid_solved;
+
+  /* One scan tells both whether the grid is consistent and solved */
+  bool solved;
+  if (!grid_scan(grid, &solved)) {
+    return grid_inconsistent;
   }
-  return grid_unsolved;
+  return solved ? grid_solved : grid_unsolved;
+}
+
+/* Trail functions */
+
+bool grid_trail_enable(grid_t *grid) {
+  if (grid == NULL) {
+    return false;
+  }
+  grid->trail_nb = 0;
+  if (grid->trail != NULL) {
+    grid->trail_enabled = true;
+    return true;
+  }
+
+  /* Along a search path every logged write removes at least one color from
+   * a cell, so size^3 entries are usually enough (size^2 more for
+   * grid_set_cell); writes that widen a cell make the trail grow */
+  size_t capacity = grid->size * grid->size * (grid->size + 1);
+  grid->trail = malloc(capacity * sizeof(trail_entry_t));
+  if (grid->trail == NULL) {
+    return false;
+  }
+  alloc_stats_heap(1);
+  grid->trail_capacity = capacity;
+  grid->trail_enabled = true;
+  alloc_stats_grid((long)(capacity * sizeof(trail_entry_t)));
+  return true;
+}
+
+size_t grid_trail_save(const grid_t *grid) {
+  if (grid == NULL) {
+    return 0;
+  }
+  return grid->trail_nb;
+}
+
+void grid_trail_restore(grid_t *grid, const size_t point) {
+  if (grid == NULL) {
+    return;
+  }
+
+  while (grid->trail_nb > point) {
+    grid->trail_nb--;
+    const trail_entry_t *entry = &grid->trail[grid->trail_nb];
+    if (entry->cell & TRAIL_UNIT) {
+      uint8_t *flags = &grid->queued[entry->cell & ~TRAIL_UNIT];
+      *flags = (*flags & ~UNIT_SUBSETS) | (entry->colors & UNIT_SUBSETS);
+    } else {
+      grid_cell_put(grid, entry->cell, entry->colors);
+    }
+  }
+  grid_events_clear(grid);
 }
 
 /* Choice functions */
@@ -297,7 +1566,9 @@ void grid_choice_apply(grid_t *grid, const choice_t choice) {
     return;
   }
 
-  grid->cells[choice.row][choice.col] = choice.color;
+  size_t cell = choice.row * grid->stride + choice.col;
+  grid_cell_write(grid, cell, choice.color);
+  grid_cell_changed(grid, cell);
 }
 
 void grid_choice_discard(grid_t *grid, const choice_t choice) {
@@ -305,8 +1576,10 @@ void grid_choice_discard(grid_t *grid, const choice_t choice) {
     return;
   }
 
-  grid->cells[choice.row][choice.col] =
-      colors_discard(grid->cells[choice.row][choice.col], log2(choice.color));
+  size_t cell = choice.row * grid->stride + choice.col;
+  grid_cell_write(grid, cell,
+                  colors_subtract(grid_cell_get(grid, cell), choice.color));
+  grid_cell_changed(grid, cell);
 }
 
 void grid_choice_print(const choice_t choice, FILE *fd) {
@@ -315,42 +1588,152 @@ void grid_choice_print(const choice_t choice, FILE *fd) {
   }
 
   fprintf(fd, "Next choice: row [%ld], col [%ld], choice = %c\n",
-          choice.row + 1, choice.col + 1, color_table[(int)log2(choice.color)]);
+          choice.row + 1, choice.col + 1, color_table[colors_index(choice.color)]);
 }
 
-choice_t grid_choice(grid_t *grid) {
-  choice_t choice;
+/* Fewest colors first, then by default the cell whose units hold the fewest
+ * unsolved cells: filling up almost solved units triggers more propagation,
+ * and timed out less often than the opposite tie-break on level-02..05. Only
+ * the first CHOICE_TIES cells of the bucket are compared, so a node costs the
+ * same whatever the size of the bucket. */
 
-  if (grid == NULL) {
-    choice.row = 0;
-    choice.col = 0;
-    choice.color = colors_empty();
-    return choice;
+#define CHOICE_TIES 32 /* cells of the fewest-colors bucket compared */
+
+static tie_break_t choice_tie_break = tie_fewest_unsolved;
+
+void grid_choice_tie_break(const tie_break_t tie_break) {
+  choice_tie_break = tie_break;
+}
+
+static size_t grid_choice_cell(const grid_t *grid) {
+  if (grid->buckets_used == colors_empty()) {
+    return BUCKET_NONE;
+  }
+
+  size_t bucket = colors_index(grid->buckets_used);
+  size_t best = grid->bucket_head[bucket];
+  size_t best_degree = 0;
+  size_t ties = 0;
+  for (size_t cell = best; cell != BUCKET_NONE && ties < CHOICE_TIES;
+       cell = grid->bucket_next[cell], ties++) {
+    const uint16_t *units = &grid->tables->cell_units[cell * GRID_UNIT_TYPES];
+    size_t degree = 0;
+    for (size_t type = 0; type < GRID_UNIT_TYPES; type++) {
+      degree += grid->unit_unsolved[units[type]];
+    }
+    if (ties == 0 || (choice_tie_break == tie_most_unsolved
+                          ? degree > best_degree
+                          : degree < best_degree)) {
+      best = cell;
+      best_degree = degree;
+    }
   }
+  return best;
+}
 
-  colors_t color_ref = colors_full(grid->size);
-  size_t row_ref = 0;
-  size_t column_ref = 0;
+/* xorshift64*, good enough to shuffle branching values */
+static inline uint64_t random_next(uint64_t *state) {
+  if (*state == 0) {
+    *state = 0x9E3779B97F4A7C15ULL;
+  }
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1DULL;
+}
 
-  for (size_t row = 0; row < grid->size; row++) {
-    for (size_t col = 0; col < grid->size; col++) {
-      if (!colors_is_singleton(grid->cells[row][col]) &&
-          colors_count(grid->cells[row][col]) <= colors_count(color_ref)) {
-        color_ref = grid->cells[row][col];
-        row_ref = row;
-        column_ref = col;
+/* Counts the colors fixed in the rows of the band and the columns of the
+ * stack of the cell: a color fixed in most blocks around the cell has few
+ * places left in its block (cross-hatching) */
+static void grid_band_counts(const grid_t *grid, const size_t cell,
+                             size_t counts[]) {
+  const grid_tables_t *tables = grid->tables;
+  size_t block_size = tables->block_size;
+  size_t first_row = cell / grid->stride / block_size * block_size;
+  size_t first_col = cell % grid->stride / block_size * block_size;
+  for (size_t line = 0; line < block_size; line++) {
+    const uint16_t *row = grid_tables_unit(tables, first_row + line);
+    const uint16_t *col =
+        grid_tables_unit(tables, tables->size + first_col + line);
+    for (size_t index = 0; index < tables->size; index++) {
+      colors_t colors = grid_cell_get(grid, row[index]);
+      if (colors_is_singleton(colors)) {
+        counts[colors_index(colors)]++;
+      }
+      colors = grid_cell_get(grid, col[index]);
+      if (colors_is_singleton(colors)) {
+        counts[colors_index(colors)]++;
+      }
+    }
+  }
+}
+
+static colors_t grid_choice_value(const grid_t *grid, const size_t cell,
+                                  const value_order_t order, uint64_t *state) {
+  colors_t colors = grid_cell_get(grid, cell);
+
+  if (order == value_random && state != NULL) {
+    return colors_select(colors, random_next(state) % colors_count(colors));
+  }
+  if (order != value_least_constraining && order != value_most_frequent) {
+    return colors_rightmost(colors);
+  }
+
+  /* Number of peers each color would be removed from (lcv), or of times it
+   * is fixed around the cell (most frequent) */
+  size_t counts[MAX_COLORS] = {0};
+  if (order == value_least_constraining) {
+    const uint16_t *peers = grid_tables_peers(grid->tables, cell);
+    for (size_t index = 0; index < grid->tables->peers_nb; index++) {
+      colors_t common = colors_and(grid_cell_get(grid, peers[index]), colors);
+      while (common != colors_empty()) {
+        counts[colors_pop(&common)]++;
       }
     }
+  } else {
+    grid_band_counts(grid, cell, counts);
+  }
+
+  colors_t best = colors_rightmost(colors);
+  colors_t others = colors_subtract(colors, best);
+  while (others != colors_empty()) {
+    size_t color = colors_pop(&others);
+    size_t best_color = colors_index(best);
+    if (order == value_least_constraining
+            ? counts[color] < counts[best_color]
+            : counts[color] > counts[best_color]) {
+      best = colors_set(color);
+    }
   }
+  return best;
+}
+
+choice_t grid_choice(grid_t *grid) {
+  return grid_choice_ordered(grid, value_lowest, NULL);
+}
 
-  choice.row = row_ref;
-  choice.col = column_ref;
-  choice.color = colors_rightmost(color_ref);
-  return (choice);
+choice_t grid_choice_ordered(grid_t *grid, const value_order_t order,
+                             uint64_t *state) {
+  choice_t choice;
+  choice.row = 0;
+  choice.col = 0;
+  choice.color = colors_empty();
+  if (grid == NULL) {
+    return choice;
+  }
+
+  size_t cell = grid_choice_cell(grid);
+  if (cell == BUCKET_NONE) {
+    return choice;
+  }
+  choice.row = cell / grid->stride;
+  choice.col = cell % grid->stride;
+  choice.color = grid_choice_value(grid, cell, order, state);
+  return choice;
 }
 
 /* For gererating grid */
 
-colors_t get_grid_color(grid_t *grid, size_t row, size_t col) {
-  return grid->cells[row][col];
+colors_t get_grid_color(const grid_t *grid, size_t row, size_t col) {
+  return grid_cell_get(grid, grid_index(grid, row, col));
 }
@@ -0,0 +1,401 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "search.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+
+#define CACHE_LINE_SIZE 64
+#define SPLIT_THRESHOLD 4 /* a worker stops splitting with this many tasks */
+
+/* A choice point of the search: the choice made and the trail restore
+ * point to go back to before discarding it */
+typedef struct {
+  size_t point;
+  choice_t choice;
+  bool delegated; /* the 'discard' branch was handed over as a task */
+} frame_t;
+
+/* Work-stealing deque: the owner pushes and pops its newest tasks at the
+ * bottom, thieves steal the oldest (and biggest) ones from the top */
+typedef struct {
+  pthread_mutex_t lock;
+  grid_t *tasks[SPLIT_THRESHOLD];
+  size_t top;
+  size_t nb;
+} deque_t;
+
+typedef struct _shared_t shared_t;
+
+/* Per-thread state, on cache lines of its own to avoid false sharing */
+typedef struct {
+  _Alignas(CACHE_LINE_SIZE) deque_t deque;
+  size_t solutions;
+  search_stats_t stats;
+  heuristic_stats_t heuristics[GRID_HEURISTICS_NB]; /* workers other than 0 */
+  fish_stats_t fish;                                /* workers other than 0 */
+  uint64_t random; /* state of value_random */
+  size_t id;
+  shared_t *shared;
+  pthread_t thread;
+} worker_t;
+
+struct _shared_t {
+  const search_t *search;
+  worker_t *workers;
+  size_t workers_nb;
+  atomic_size_t pending; /* tasks pushed and not explored yet */
+  atomic_bool stop;
+  pthread_mutex_t report; /* serializes the calls to 'on_solution' */
+  alloc_group_t grids;    /* grid memory of the workers, when several */
+};
+
+static _Thread_local arena_t scratch; /* temporary buffers of the search */
+
+/* Deques */
+
+static size_t deque_size(deque_t *deque) {
+  pthread_mutex_lock(&deque->lock);
+  size_t nb = deque->nb;
+  pthread_mutex_unlock(&deque->lock);
+  return nb;
+}
+
+static bool deque_push(deque_t *deque, grid_t *task) {
+  bool pushed = false;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->nb < SPLIT_THRESHOLD) {
+    deque->tasks[(deque->top + deque->nb) % SPLIT_THRESHOLD] = task;
+    deque->nb++;
+    pushed = true;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return pushed;
+}
+
+static grid_t *deque_pop(deque_t *deque) {
+  grid_t *task = NULL;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->nb > 0) {
+    deque->nb--;
+    task = deque->tasks[(deque->top + deque->nb) % SPLIT_THRESHOLD];
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return task;
+}
+
+static grid_t *deque_steal(deque_t *deque) {
+  grid_t *task = NULL;
+  pthread_mutex_lock(&deque->lock);
+  if (deque->nb > 0) {
+    task = deque->tasks[deque->top];
+    deque->top = (deque->top + 1) % SPLIT_THRESHOLD;
+    deque->nb--;
+  }
+  pthread_mutex_unlock(&deque->lock);
+  return task;
+}
+
+/* Search */
+
+/* Hands the 'discard' branch of a choice over to the other workers, as long
+ * as the deque of the worker is not full */
+static bool search_split(worker_t *worker, const grid_t *grid,
+                         const choice_t choice) {
+  shared_t *shared = worker->shared;
+  if (shared->workers_nb == 1 ||
+      deque_size(&worker->deque) >= SPLIT_THRESHOLD) {
+    return false;
+  }
+
+  grid_t *task = grid_copy(grid);
+  if (task == NULL) {
+    return false;
+  }
+  grid_choice_discard(task, choice);
+
+  atomic_fetch_add(&shared->pending, 1);
+  if (!deque_push(&worker->deque, task)) {
+    atomic_fetch_sub(&shared->pending, 1);
+    grid_free(task);
+    return false;
+  }
+  return true;
+}
+
+static void search_report(worker_t *worker, const grid_t *grid) {
+  shared_t *shared = worker->shared;
+  const search_t *search = shared->search;
+
+  worker->solutions++;
+  if (search->on_solution == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&shared->report);
+  if (!atomic_load(&shared->stop) &&
+      !search->on_solution(grid, search->data)) {
+    atomic_store(&shared->stop, true);
+  }
+  pthread_mutex_unlock(&shared->report);
+}
+
+/* Depth-first exploration of a task, in place, undoing choices with the
+ * trail of the grid */
+static void search_task(worker_t *worker, grid_t *grid) {
+  shared_t *shared = worker->shared;
+  const search_t *search = shared->search;
+  size_t size = grid_get_size(grid);
+  size_t cursor = arena_save(&scratch);
+  frame_t *stack = arena_alloc(&scratch, size * size * sizeof(frame_t));
+  if (stack == NULL || !grid_trail_enable(grid)) {
+    atomic_store(&shared->stop, true);
+    arena_restore(&scratch, cursor);
+    grid_free(grid);
+    return;
+  }
+  size_t depth = 0;
+
+  while (!atomic_load_explicit(&shared->stop, memory_order_relaxed)) {
+    status_t status = grid_heuristics(grid);
+    worker->stats.nodes++;
+
+    if (status == grid_solved) {
+      search_report(worker, grid);
+    }
+
+    if (status == grid_unsolved) {
+      choice_t choice =
+          grid_choice_ordered(grid, search->order, &worker->random);
+      if (!grid_choice_is_empty(choice)) {
+        if (search->verbose) {
+          grid_choice_print(choice, search->fd);
+        }
+        stack[depth].point = grid_trail_save(grid);
+        stack[depth].choice = choice;
+        stack[depth].delegated = search_split(worker, grid, choice);
+        depth++;
+        if (depth > worker->stats.max_depth) {
+          worker->stats.max_depth = depth;
+        }
+        grid_choice_apply(grid, choice);
+        continue;
+      }
+    }
+
+    /* Dead end (or solution already counted): undo the last choice and
+     * discard it from the cell, unless another task took care of it */
+    bool resumed = false;
+    while (depth > 0 && !resumed) {
+      depth--;
+      worker->stats.backtracks++;
+      grid_trail_restore(grid, stack[depth].point);
+      if (!stack[depth].delegated) {
+        grid_choice_discard(grid, stack[depth].choice);
+        resumed = true;
+      }
+    }
+    if (!resumed) {
+      break;
+    }
+  }
+
+  arena_restore(&scratch, cursor);
+  grid_free(grid);
+}
+
+static void *worker_run(void *data) {
+  worker_t *worker = data;
+  shared_t *shared = worker->shared;
+
+  /* A task can be given back by another worker than the one that took it */
+  if (shared->workers_nb > 1) {
+    alloc_group_join(&shared->grids);
+  }
+
+  while (!atomic_load(&shared->stop)) {
+    grid_t *task = deque_pop(&worker->deque);
+    for (size_t offset = 1; task == NULL && offset < shared->workers_nb;
+         offset++) {
+      size_t victim = (worker->id + offset) % shared->workers_nb;
+      task = deque_steal(&shared->workers[victim].deque);
+    }
+
+    if (task != NULL) {
+      search_task(worker, task);
+      atomic_fetch_sub(&shared->pending, 1);
+    } else if (atomic_load(&shared->pending) == 0) {
+      break;
+    } else {
+      sched_yield();
+    }
+  }
+
+  /* Grids and buffers of a thread can only be reused by that thread */
+  if (worker->id != 0) {
+    grid_pool_release();
+    search_release();
+
+    for (size_t heuristic = 0; heuristic < GRID_HEURISTICS_NB; heuristic++) {
+      worker->heuristics[heuristic] = grid_heuristic_stats(heuristic);
+    }
+    worker->fish = grid_fish_stats();
+    struct timespec cpu;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu) == 0) {
+      worker->stats.worker_cpu_ns =
+          (uint64_t)cpu.tv_sec * 1000000000ULL + (uint64_t)cpu.tv_nsec;
+    }
+  }
+  alloc_group_join(NULL);
+  return NULL;
+}
+
+size_t search_run(grid_t *grid, const search_t *search) {
+  if (grid == NULL || search == NULL) {
+    grid_free(grid);
+    return 0;
+  }
+
+  shared_t shared;
+  shared.search = search;
+  shared.workers_nb = search->threads;
+  if (shared.workers_nb < 1 || shared.workers_nb > SEARCH_MAX_THREADS) {
+    shared.workers_nb = 1;
+  }
+  shared.workers =
+      aligned_alloc(CACHE_LINE_SIZE, shared.workers_nb * sizeof(worker_t));
+  if (shared.workers == NULL) {
+    grid_free(grid);
+    return 0;
+  }
+  atomic_init(&shared.pending, 1);
+  atomic_init(&shared.stop, false);
+  pthread_mutex_init(&shared.report, NULL);
+  alloc_group_init(&shared.grids);
+
+  for (size_t id = 0; id < shared.workers_nb; id++) {
+    worker_t *worker = &shared.workers[id];
+    pthread_mutex_init(&worker->deque.lock, NULL);
+    worker->deque.top = 0;
+    worker->deque.nb = 0;
+    worker->solutions = 0;
+    memset(&worker->stats, 0, sizeof(worker->stats));
+    memset(worker->heuristics, 0, sizeof(worker->heuristics));
+    memset(&worker->fish, 0, sizeof(worker->fish));
+    worker->random = search->seed + id * 0x9E3779B97F4A7C15ULL;
+    worker->id = id;
+    worker->shared = &shared;
+  }
+  deque_push(&shared.workers[0].deque, grid);
+
+  /* The calling thread is worker 0, a worker that cannot be started simply
+   * gets its tasks stolen by the others */
+  bool started[shared.workers_nb];
+  for (size_t id = 1; id < shared.workers_nb; id++) {
+    started[id] = pthread_create(&shared.workers[id].thread, NULL, worker_run,
+                                 &shared.workers[id]) == 0;
+  }
+  worker_run(&shared.workers[0]);
+
+  size_t solutions = 0;
+  search_stats_t stats = {0, 0, 0, 0};
+  for (size_t id = 0; id < shared.workers_nb; id++) {
+    worker_t *worker = &shared.workers[id];
+    if (id > 0 && started[id]) {
+      pthread_join(worker->thread, NULL);
+    }
+    solutions += worker->solutions;
+    stats.nodes += worker->stats.nodes;
+    stats.backtracks += worker->stats.backtracks;
+    stats.worker_cpu_ns += worker->stats.worker_cpu_ns;
+    if (worker->stats.max_depth > stats.max_depth) {
+      stats.max_depth = worker->stats.max_depth;
+    }
+  }
+  if (search->stats != NULL) {
+    *search->stats = stats;
+    for (size_t id = 1; id < shared.workers_nb; id++) {
+      for (size_t heuristic = 0; heuristic < GRID_HEURISTICS_NB;
+           heuristic++) {
+        grid_heuristic_stats_add(heuristic,
+                                 shared.workers[id].heuristics[heuristic]);
+      }
+      grid_fish_stats_add(shared.workers[id].fish);
+    }
+  }
+
+  alloc_group_merge(&shared.grids);
+
+  /* Tasks left behind by a stopped search */
+  for (size_t id = 0; id < shared.workers_nb; id++) {
+    grid_t *task;
+    while ((task = deque_pop(&shared.workers[id].deque)) != NULL) {
+      grid_free(task);
+    }
+    pthread_mutex_destroy(&shared.workers[id].deque.lock);
+  }
+  pthread_mutex_destroy(&shared.report);
+  free(shared.workers);
+  return solutions;
+}
+
+/* State of a bounded count */
+typedef struct {
+  size_t solutions;
+  size_t limit;
+  grid_t *first; /* copy of the first solution, if asked for */
+  bool keep;
+} count_query_t;
+
+static bool count_on_solution(const grid_t *solution, void *data) {
+  count_query_t *query = data;
+  query->solutions++;
+  if (query->solutions == 1 && query->keep) {
+    query->first = grid_copy(solution);
+  }
+  return query->solutions < query->limit;
+}
+
+static void count_run(const grid_t *grid, const size_t threads,
+                      count_query_t *query, search_stats_t *stats) {
+  search_t search = {threads, false,       NULL, count_on_solution,
+                     query,   value_lowest, 0,    stats};
+  search_run(grid_copy(grid), &search);
+}
+
+size_t search_count(const grid_t *grid, const size_t threads,
+                    const size_t limit, search_stats_t *stats) {
+  if (limit == 0) {
+    return 0;
+  }
+  count_query_t query = {0, limit, NULL, false};
+  count_run(grid, threads, &query, stats);
+  return query.solutions;
+}
+
+uniqueness_t search_unique(const grid_t *grid, const size_t threads,
+                           grid_t **solution, search_stats_t *stats) {
+  count_query_t query = {0, 2, NULL, solution != NULL};
+  count_run(grid, threads, &query, stats);
+
+  uniqueness_t answer = query.solutions == 0   ? solutions_none
+                        : query.solutions == 1 ? solutions_unique
+                                               : solutions_many;
+  if (answer != solutions_unique) {
+    grid_free(query.first);
+    query.first = NULL;
+  }
+  if (solution != NULL) {
+    *solution = query.first;
+  }
+  return answer;
+}
+
+void search_release(void) {
+  arena_release(&scratch);
+}
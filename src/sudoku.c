@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "sudoku.h"
 
 #include <stdbool.h>
@@ -7,15 +9,28 @@
 
 #include <err.h>
 #include <getopt.h>
+#include <inttypes.h>
 #include <math.h>
+#include <pthread.h>
+#include <string.h>
 #include <time.h>
 
+#include "arena.h"
+#include "cdcl.h"
+#include "dlx.h"
 #include "grid.h"
+#include "search.h"
 
 static bool verbose = false;
 static bool unique = false;
-static int solutions = 0;
+static uint64_t max_solutions = 0; /* 0 for no limit */
+static size_t clues_wanted = 0;     /* 0 for FILLING_RATE of the cells */
 static int grid_size = DEFAULT_GRID_SIZE;
+static size_t jobs = 1;           /* threads given with '-j' */
+static size_t search_threads = 1; /* threads of a backtracking search */
+static value_order_t value_order = value_lowest;
+static uint64_t value_seed = 0;
+static stats_tt stats_format = stats_none;
 
 /* Function used to initialise a seed once */
 
@@ -27,55 +42,347 @@ static void seed_init(unsigned int seed) {
   }
 }
 
-/* Backtrack */
+/* Engines */
+
+/* State of one resolution: engines only touch this, so that several files
+ * can be solved at the same time */
+typedef struct {
+  mode_tt mode;
+  FILE *fd;
+  uint64_t solutions;
+  grid_t *first; /* copy of the first solution (mode_first) */
+  search_stats_t stats; /* nodes, backtracks and depth of any engine */
+} engine_context_t;
+
+typedef grid_t *(*engine_t)(grid_t *, engine_context_t *);
+
+static bool engine_on_solution(const grid_t *solution, void *data) {
+  engine_context_t *context = data;
+  context->solutions++;
+  if (context->mode == mode_first) {
+    context->first = grid_copy(solution);
+    return false;
+  }
+  if (context->mode == mode_all && !unique) {
+    fprintf(context->fd, "Solution #%" PRIu64 ":\n", context->solutions);
+    grid_print(solution, context->fd);
+  }
+  if (context->mode == mode_unique) {
+    return context->solutions < 2;
+  }
+  return max_solutions == 0 || context->solutions < max_solutions;
+}
+
+/* Nothing to do per solution: the engines count them on their own, without
+ * building the solution grids */
+static bool engine_counts_alone(const engine_context_t *context) {
+  return context->mode == mode_count && max_solutions == 0;
+}
+
+static grid_t *backtrack(grid_t *grid, engine_context_t *context) {
+  search_t search = {search_threads,     verbose,     context->fd,
+                     engine_on_solution, context,     value_order,
+                     value_seed,         &context->stats};
+  if (context->mode == mode_unique) {
+    uniqueness_t answer =
+        search_unique(grid, search_threads, NULL, &context->stats);
+    context->solutions = answer == solutions_none     ? 0
+                         : answer == solutions_unique ? 1
+                                                      : 2;
+    grid_free(grid);
+    return NULL;
+  }
+  if (engine_counts_alone(context)) {
+    search.on_solution = NULL;
+    context->solutions = search_run(grid, &search);
+    return NULL;
+  }
+  search_run(grid, &search);
+  return context->first;
+}
 
-static grid_t *backtrack(grid_t *grid, const mode_tt mode, FILE *fd) {
+static grid_t *dlx_engine(grid_t *grid, engine_context_t *context) {
   if (grid == NULL) {
     return NULL;
   }
-  while (grid_is_consistent(grid)) {
-    while (subgrid_apply(grid, subgrid_heuristics))
-      ;
-    if (grid_is_solved(grid)) {
-      if (grid_is_consistent(grid)) {
-        solutions++;
-        if (mode == mode_all) {
-          if (!unique) {
-            fprintf(fd, "Solution #%d:\n", solutions);
-            grid_print(grid, fd);
-          }
-          grid_free(grid);
-          return NULL;
-        }
-        return grid;
-      }
-    }
 
-    choice_t choice = grid_choice(grid);
-    if (choice.color == 0) {
-      grid_free(grid);
-      return NULL;
+  /* Propagation first: the fewer candidates, the smaller the matrix */
+  if (grid_heuristics(grid) == grid_inconsistent) {
+    grid_free(grid);
+    return NULL;
+  }
+
+  dlx_t *dlx = dlx_alloc(grid);
+  grid_free(grid);
+  if (dlx == NULL) {
+    return NULL;
+  }
+  if (engine_counts_alone(context)) {
+    context->solutions = dlx_search(dlx, NULL, NULL);
+  } else {
+    dlx_search(dlx, engine_on_solution, context);
+  }
+  dlx_stats_t stats = dlx_stats(dlx);
+  context->stats.nodes = stats.nodes;
+  context->stats.backtracks = stats.dead_ends;
+  context->stats.max_depth = stats.max_level;
+  dlx_free(dlx);
+  return context->first;
+}
+
+static grid_t *cdcl_engine(grid_t *grid, engine_context_t *context) {
+  if (grid == NULL) {
+    return NULL;
+  }
+
+  if (grid_heuristics(grid) == grid_inconsistent) {
+    grid_free(grid);
+    return NULL;
+  }
+
+  cdcl_t *cdcl = cdcl_alloc(grid);
+  grid_free(grid);
+  if (cdcl == NULL) {
+    return NULL;
+  }
+  if (engine_counts_alone(context)) {
+    context->solutions = cdcl_search(cdcl, NULL, NULL);
+  } else {
+    cdcl_search(cdcl, engine_on_solution, context);
+  }
+  if (cdcl_failed(cdcl)) {
+    cdcl_free(cdcl);
+    grid_free(context->first);
+    errx(EXIT_FAILURE, "error: the CDCL search ran out of memory!");
+  }
+  cdcl_stats_t stats = cdcl_stats(cdcl);
+  context->stats.nodes = stats.decisions;
+  context->stats.backtracks = stats.conflicts;
+  context->stats.max_depth = stats.max_level;
+  if (verbose) {
+    fprintf(context->fd,
+            "CDCL: %zu decision(s), %zu conflict(s), %zu learned clause(s) "
+            "(%zu deleted), %zu restart(s), max level %zu\n\n",
+            stats.decisions, stats.conflicts, stats.learned, stats.deleted,
+            stats.restarts, stats.max_level);
+  }
+  cdcl_free(cdcl);
+  return context->first;
+}
+
+static void fish_stats_print(FILE *fd) {
+  fish_stats_t stats = grid_fish_stats();
+  if (stats.calls == 0) {
+    return;
+  }
+  fprintf(fd,
+          "Fish: %zu stage(s), %zu set(s) of lines, %zu x-wing(s), "
+          "%zu swordfish, %zu jellyfish, %zu elimination(s), "
+          "%zu budget cut(s)\n\n",
+          stats.calls, stats.combinations, stats.found[2], stats.found[3],
+          stats.found[4], stats.eliminations, stats.exhausted);
+}
+
+static void heuristic_stats_print(FILE *fd) {
+  heuristic_t stages[GRID_HEURISTICS_NB];
+  size_t stages_nb = grid_pipeline_get(stages);
+  fprintf(fd, "Heuristics (%s pipeline):\n",
+          grid_pipeline_is_adaptive() ? "adaptive" : "fixed");
+  for (size_t stage = 0; stage < stages_nb; stage++) {
+    heuristic_stats_t stats = grid_heuristic_stats(stages[stage]);
+    fprintf(fd,
+            "  %-8s %zu run(s), %zu skipped, %zu back-off(s), "
+            "%zu elimination(s), %.3f ms\n",
+            grid_heuristic_name(stages[stage]), stats.runs, stats.skips,
+            stats.backoffs, stats.eliminations, stats.nanoseconds / 1e6);
+  }
+  fputc('\n', fd);
+}
+
+/**
+@brief: parses a comma separated list of stages into a fixed pipeline
+            ('singles' is added in front if missing), or 'adaptive' for the
+            default stages with back-off
+@param: const char *list, bool *fish
+@return: bool (false if the list is invalid)
+**/
+static bool pipeline_parse(const char *list, bool *fish) {
+  static const heuristic_t defaults[] = {heuristic_singles, heuristic_locked,
+                                         heuristic_subsets, heuristic_fish};
+  if (strcmp(list, "adaptive") == 0) {
+    return grid_pipeline_set(defaults, GRID_HEURISTICS_NB, true);
+  }
+
+  heuristic_t stages[GRID_HEURISTICS_NB + 1] = {heuristic_singles};
+  size_t stages_nb = 1;
+  while (*list != '\0') {
+    size_t length = strcspn(list, ",");
+    size_t heuristic = 0;
+    while (heuristic < GRID_HEURISTICS_NB &&
+           (strlen(grid_heuristic_name(heuristic)) != length ||
+            strncmp(list, grid_heuristic_name(heuristic), length) != 0)) {
+      heuristic++;
     }
-    if (verbose) {
-      grid_choice_print(choice, fd);
+    if (heuristic == GRID_HEURISTICS_NB || stages_nb > GRID_HEURISTICS_NB) {
+      return false;
     }
-    grid_t *copy = grid_copy(grid);
-    if (copy == NULL) {
-      grid_free(grid);
-      return NULL;
+    /* 'singles' is only allowed first, where it already is */
+    if (heuristic != heuristic_singles || stages_nb > 1) {
+      stages[stages_nb++] = heuristic;
     }
-    grid_choice_apply(copy, choice);
-    copy = backtrack(copy, mode, fd);
-    if (copy == NULL) {
-      grid_choice_discard(grid, choice);
+    *fish |= heuristic == heuristic_fish;
+    list += length + (list[length] == ',');
+  }
+  return grid_pipeline_set(stages, stages_nb, false);
+}
+
+static void alloc_stats_print(FILE *fd) {
+  alloc_stats_t stats = alloc_stats_get();
+  fprintf(fd,
+          "Allocations: %zu heap allocation(s), %zu heap free(s), "
+          "%zu recycled grid(s), %zu bytes of arena (peak)\n\n",
+          stats.heap_allocs, stats.heap_frees, stats.pool_hits,
+          stats.arena_peak);
+}
+
+/* Statistics */
+
+/* Solver statistics of one file */
+typedef struct {
+  double parse_ms;
+  size_t passes; /* runs of the propagation (singles stage) */
+  size_t eliminations[GRID_HEURISTICS_NB];
+  size_t nodes;
+  size_t backtracks;
+  size_t max_depth;
+  uint64_t solutions;
+  double wall_ms;
+  double cpu_ms; /* solving thread and search workers */
+  size_t grid_peak; /* bytes of grids in use at the same time */
+} file_stats_t;
+
+static double clock_ms(const clockid_t clock) {
+  struct timespec now;
+  if (clock_gettime(clock, &now) != 0) {
+    return 0;
+  }
+  return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static void json_string_print(const char *string, FILE *fd) {
+  fputc('"', fd);
+  for (const char *c = string; *c != '\0'; c++) {
+    if (*c == '"' || *c == '\\') {
+      fprintf(fd, "\\%c", *c);
+    } else if ((unsigned char)*c < 0x20) {
+      fprintf(fd, "\\u%04x", (unsigned char)*c);
     } else {
-      grid_free(grid);
-      return copy;
+      fputc(*c, fd);
     }
   }
+  fputc('"', fd);
+}
 
-  grid_free(grid);
-  return NULL;
+static void file_stats_print(const char *filename, const file_stats_t *stats,
+                             FILE *fd) {
+  if (stats_format == stats_json) {
+    fprintf(fd, "{\"file\":");
+    json_string_print(filename, fd);
+    fprintf(fd, ",\"parse_ms\":%.3f,\"passes\":%zu,\"eliminations\":{",
+            stats->parse_ms, stats->passes);
+    for (size_t heuristic = 0; heuristic < GRID_HEURISTICS_NB; heuristic++) {
+      fprintf(fd, "%s\"%s\":%zu", heuristic > 0 ? "," : "",
+              grid_heuristic_name(heuristic), stats->eliminations[heuristic]);
+    }
+    fprintf(fd,
+            "},\"nodes\":%zu,\"backtracks\":%zu,\"max_depth\":%zu,"
+            "\"solutions\":%" PRIu64 ",\"wall_ms\":%.3f,\"cpu_ms\":%.3f,"
+            "\"grid_peak_bytes\":%zu}\n",
+            stats->nodes, stats->backtracks, stats->max_depth,
+            stats->solutions, stats->wall_ms, stats->cpu_ms, stats->grid_peak);
+    return;
+  }
+
+  fprintf(fd,
+          "Statistics: parse %.3f ms, %zu propagation pass(es), %zu node(s), "
+          "%zu backtrack(s), max depth %zu, %" PRIu64 " solution(s)\n"
+          "  eliminations:",
+          stats->parse_ms, stats->passes, stats->nodes, stats->backtracks,
+          stats->max_depth, stats->solutions);
+  for (size_t heuristic = 0; heuristic < GRID_HEURISTICS_NB; heuristic++) {
+    fprintf(fd, "%s %s %zu", heuristic > 0 ? "," : "",
+            grid_heuristic_name(heuristic), stats->eliminations[heuristic]);
+  }
+  fprintf(fd, "\n  wall %.3f ms, cpu %.3f ms, peak grid memory %zu bytes\n\n",
+          stats->wall_ms, stats->cpu_ms, stats->grid_peak);
+}
+
+static int wall_compare(const void *a, const void *b) {
+  double wall_a = *(const double *)a, wall_b = *(const double *)b;
+  return (wall_a > wall_b) - (wall_a < wall_b);
+}
+
+/**
+@brief: prints the wall time distribution of the solved files: min, median,
+            95th percentile, max and a histogram with power of two buckets
+@param: double walls[] (sorted in place), const size_t walls_nb, FILE *fd
+@return: void
+**/
+static void latency_summary_print(double walls[], const size_t walls_nb,
+                                  FILE *fd) {
+  if (walls_nb == 0) {
+    return;
+  }
+  qsort(walls, walls_nb, sizeof(double), wall_compare);
+
+  double total = 0;
+  size_t histogram[STATS_HISTOGRAM_BUCKETS] = {0};
+  for (size_t index = 0; index < walls_nb; index++) {
+    size_t bucket = 0;
+    while (bucket < STATS_HISTOGRAM_BUCKETS - 1 &&
+           walls[index] >= (double)(1UL << bucket)) {
+      bucket++;
+    }
+    histogram[bucket]++;
+    total += walls[index];
+  }
+  double median = walls[(walls_nb - 1) / 2];
+  double p95 = walls[(size_t)ceil(0.95 * walls_nb) - 1];
+
+  if (stats_format == stats_json) {
+    fprintf(fd,
+            "{\"summary\":{\"files\":%zu,\"total_ms\":%.3f,"
+            "\"min_ms\":%.3f,\"median_ms\":%.3f,\"p95_ms\":%.3f,"
+            "\"max_ms\":%.3f,\"histogram\":[",
+            walls_nb, total, walls[0], median, p95, walls[walls_nb - 1]);
+    for (size_t bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++) {
+      if (bucket < STATS_HISTOGRAM_BUCKETS - 1) {
+        fprintf(fd, "%s{\"lt_ms\":%lu,\"count\":%zu}", bucket > 0 ? "," : "",
+                1UL << bucket, histogram[bucket]);
+      } else {
+        fprintf(fd, ",{\"lt_ms\":null,\"count\":%zu}", histogram[bucket]);
+      }
+    }
+    fprintf(fd, "]}}\n");
+    return;
+  }
+
+  fprintf(fd,
+          "Latency: %zu file(s), total %.3f ms, min %.3f ms, median %.3f ms, "
+          "p95 %.3f ms, max %.3f ms\n",
+          walls_nb, total, walls[0], median, p95, walls[walls_nb - 1]);
+  for (size_t bucket = 0; bucket < STATS_HISTOGRAM_BUCKETS; bucket++) {
+    if (histogram[bucket] == 0) {
+      continue;
+    }
+    if (bucket < STATS_HISTOGRAM_BUCKETS - 1) {
+      fprintf(fd, "  < %5lu ms: %zu\n", 1UL << bucket, histogram[bucket]);
+    } else {
+      fprintf(fd, "  >= %4lu ms: %zu\n", 1UL << (bucket - 1),
+              histogram[bucket]);
+    }
+  }
+  fputc('\n', fd);
 }
 
 static void cleaning(FILE *filename, grid_t *grid) {
@@ -90,7 +397,9 @@ static void cleaning(FILE *filename, grid_t *grid) {
 
 /* Generator */
 
-static grid_t *grid_generator(size_t size, FILE *fd) {
+/* Fills a grid at random: first row, first block and first column, the
+ * rest by backtracking */
+static grid_t *grid_fill(size_t size, FILE *fd) {
   grid_t *grid = grid_alloc(size);
   if (grid == NULL) {
     return NULL;
@@ -111,13 +420,13 @@ static grid_t *grid_generator(size_t size, FILE *fd) {
   /* First row */
   for (size_t col = 0; col < size; col++) {
     color = colors_random(color_choice);
-    grid_set_cell(grid, 0, col, color_table[(int)log2(color)]);
-    color_choice = colors_discard(color_choice, (int)log2(color));
+    grid_set_cell(grid, 0, col, color_table[colors_index(color)]);
+    color_choice = colors_discard(color_choice, colors_index(color));
     if (col == 0) {
-      color_after_block = colors_discard(color_after_block, (int)log2(color));
+      color_after_block = colors_discard(color_after_block, colors_index(color));
     }
     if (col < sqrt_s) {
-      color_after_row = colors_discard(color_after_row, (int)log2(color));
+      color_after_row = colors_discard(color_after_row, colors_index(color));
     }
   }
 
@@ -125,10 +434,10 @@ static grid_t *grid_generator(size_t size, FILE *fd) {
   for (size_t row = 1; row < sqrt_s; row++) {
     for (size_t col = 0; col < sqrt_s; col++) {
       color = colors_random(color_after_row);
-      grid_set_cell(grid, row, col, color_table[(int)log2(color)]);
-      color_after_row = colors_discard(color_after_row, (int)log2(color));
+      grid_set_cell(grid, row, col, color_table[colors_index(color)]);
+      color_after_row = colors_discard(color_after_row, colors_index(color));
       if (col == 0) {
-        color_after_block = colors_discard(color_after_block, (int)log2(color));
+        color_after_block = colors_discard(color_after_block, colors_index(color));
       }
     }
   }
@@ -136,33 +445,101 @@ static grid_t *grid_generator(size_t size, FILE *fd) {
   /* First column */
   for (size_t row = sqrt_s; row < size; row++) {
     color = colors_random(color_after_block);
-    grid_set_cell(grid, row, 0, color_table[(int)log2(color)]);
-    color_after_block = colors_discard(color_after_block, (int)log2(color));
+    grid_set_cell(grid, row, 0, color_table[colors_index(color)]);
+    color_after_block = colors_discard(color_after_block, colors_index(color));
   }
-  grid_t *after_backtrack = backtrack(grid, mode_first, fd);
+  engine_context_t context = {mode_first, fd, 0, NULL, {0, 0, 0, 0}};
+  return backtrack(grid, &context);
+}
+
+/* Removes random clues of a solved grid down to 'clues' of them, with no
+ * care for the number of solutions */
+static size_t grid_dig(grid_t *grid, const size_t clues) {
+  size_t size = grid_get_size(grid);
   size_t cells_filled = size * size;
-  size_t cells_filled_wanted = size * size * FILLING_RATE;
 
-  while (cells_filled > cells_filled_wanted) {
+  while (cells_filled > clues) {
     size_t row = rand() % (size);
     size_t col = rand() % (size);
-    grid_t *copy = grid_copy(after_backtrack);
-    if (!unique) {
-      if (colors_is_singleton(get_grid_color(after_backtrack, row, col))) {
-        grid_set_cell(after_backtrack, row, col, colors_full(size));
-        cells_filled--;
-      }
+    if (colors_is_singleton(get_grid_color(grid, row, col))) {
+      grid_set_cell(grid, row, col, colors_full(size));
+      cells_filled--;
+    }
+  }
+  return cells_filled;
+}
+
+/**
+@brief: removes the clues of a solved grid one at a time, in random order,
+            down to 'clues' of them, putting back each clue whose removal
+            gives the grid another solution. As the grid has a unique solution
+            before each removal, any other solution afterwards puts another
+            color in the emptied cell: the check only looks for one solution
+            with the clue discarded from the cell
+@param: grid_t *grid, const size_t clues
+@return: size_t (number of clues left, more than 'clues' if every other clue
+            is needed)
+**/
+static size_t grid_dig_unique(grid_t *grid, const size_t clues) {
+  size_t size = grid_get_size(grid);
+  size_t cells_nb = size * size;
+  size_t cells_filled = cells_nb;
+
+  size_t order[cells_nb];
+  for (size_t cell = 0; cell < cells_nb; cell++) {
+    order[cell] = cell;
+  }
+  for (size_t cell = cells_nb - 1; cell > 0; cell--) {
+    size_t other = rand() % (cell + 1);
+    size_t swap = order[cell];
+    order[cell] = order[other];
+    order[other] = swap;
+  }
+
+  for (size_t index = 0; index < cells_nb && cells_filled > clues; index++) {
+    size_t row = order[index] / size, col = order[index] % size;
+    colors_t clue = get_grid_color(grid, row, col);
+    choice_t others = {row, col, colors_subtract(colors_full(size), clue)};
+    grid_choice_apply(grid, others);
+    if (search_count(grid, search_threads, 1, NULL) == 0) {
+      others.color = colors_full(size);
+      cells_filled--;
     } else {
-      copy = backtrack(after_backtrack, mode_all, fd);
-      if (solutions == 1) {
-        return copy;
-      }
-      return grid_generator(size, fd);
+      others.color = clue;
     }
-    grid_free(copy);
+    grid_choice_apply(grid, others);
   }
+  return cells_filled;
+}
 
-  return after_backtrack;
+/**
+@brief: generates a grid of 'clues' clues (with a unique solution if asked
+            for), keeping the grid with the fewest clues when
+            GENERATOR_ATTEMPTS solved grids could not be dug down to it
+@param: size_t size, const size_t clues, size_t *clues_left, FILE *fd
+@return: grid_t * (NULL if no grid could be filled)
+**/
+static grid_t *grid_generator(size_t size, const size_t clues,
+                              size_t *clues_left, FILE *fd) {
+  grid_t *best = NULL;
+  *clues_left = size * size + 1;
+
+  for (size_t attempt = 0;
+       attempt < GENERATOR_ATTEMPTS && *clues_left > clues; attempt++) {
+    grid_t *grid = grid_fill(size, fd);
+    if (grid == NULL) {
+      break;
+    }
+    size_t left = unique ? grid_dig_unique(grid, clues) : grid_dig(grid, clues);
+    if (left < *clues_left) {
+      grid_free(best);
+      best = grid;
+      *clues_left = left;
+    } else {
+      grid_free(grid);
+    }
+  }
+  return best;
 }
 
 /* File Parser */
@@ -313,31 +690,331 @@ static grid_t *file_parser(char *filename) {
   return grid;
 }
 
+/* Solving */
+
+/**
+@brief: parses, solves and prints a grid file on 'output', with its
+            statistics if they were asked for
+@param: const char *filename, engine_t solve, const mode_tt mode,
+            FILE *output, file_stats_t *stats (NULL if not needed)
+@return: outcome_tt (outcome_inconsistent stops the program)
+**/
+static outcome_tt file_solve(const char *filename, engine_t solve,
+                             const mode_tt mode, FILE *output,
+                             file_stats_t *stats) {
+  fprintf(output, "====================%s====================\n\n", filename);
+  double wall_start = clock_ms(CLOCK_MONOTONIC);
+  double cpu_start = clock_ms(CLOCK_THREAD_CPUTIME_ID);
+  alloc_stats_reset();
+  grid_fish_stats_reset();
+  grid_heuristic_stats_reset();
+  grid_t *grid_test = file_parser((char *)filename);
+  if (grid_test == NULL) {
+    return outcome_invalid;
+  }
+  double parse_ms = clock_ms(CLOCK_MONOTONIC) - wall_start;
+
+  fprintf(output, "Initial grid:\n");
+  grid_print(grid_test, output);
+  if (!grid_is_consistent(grid_test)) {
+    grid_free(grid_test);
+    return outcome_inconsistent;
+  }
+  engine_context_t context = {mode, output, 0, NULL, {0, 0, 0, 0}};
+  grid_test = solve(grid_test, &context);
+  if (mode == mode_all || mode == mode_count) {
+    if (context.solutions == 0) {
+      grid_free(grid_test);
+      return outcome_inconsistent;
+    }
+    fprintf(output, "There are '%" PRIu64 "' solutions\n\n",
+            context.solutions);
+  }
+
+  if (mode == mode_unique) {
+    if (context.solutions == 0) {
+      return outcome_inconsistent;
+    }
+    fprintf(output, "The grid has %s\n\n",
+            context.solutions == 1 ? "a unique solution"
+                                   : "several solutions");
+  }
+
+  if (mode == mode_first) {
+    if (grid_test == NULL) {
+      return outcome_inconsistent;
+    }
+    fprintf(output, "Solved grid:\n");
+    grid_print(grid_test, output);
+  }
+  grid_free(grid_test);
+
+  if (stats != NULL) {
+    stats->parse_ms = parse_ms;
+    stats->passes = grid_heuristic_stats(heuristic_singles).runs;
+    for (size_t heuristic = 0; heuristic < GRID_HEURISTICS_NB; heuristic++) {
+      stats->eliminations[heuristic] =
+          grid_heuristic_stats(heuristic).eliminations;
+    }
+    stats->nodes = context.stats.nodes;
+    stats->backtracks = context.stats.backtracks;
+    stats->max_depth = context.stats.max_depth;
+    stats->solutions = context.solutions;
+    stats->wall_ms = clock_ms(CLOCK_MONOTONIC) - wall_start;
+    stats->cpu_ms = clock_ms(CLOCK_THREAD_CPUTIME_ID) - cpu_start +
+                    context.stats.worker_cpu_ns / 1e6;
+    stats->grid_peak = alloc_stats_get().grid_peak;
+    if (stats_format != stats_none) {
+      file_stats_print(filename, stats, output);
+    }
+  }
+  if (verbose) {
+    heuristic_stats_print(output);
+    fish_stats_print(output);
+    alloc_stats_print(output);
+  }
+  return outcome_solved;
+}
+
+/* Batch */
+
+/* A file of the batch, printed in its own buffer */
+typedef struct {
+  const char *filename;
+  char *buffer;
+  size_t length;
+  outcome_tt outcome;
+  file_stats_t stats;
+  bool done;
+} job_t;
+
+typedef struct {
+  job_t *jobs;
+  size_t jobs_nb;
+  size_t next; /* next job to start */
+  bool stop;   /* an inconsistent grid ends the batch */
+  engine_t solve;
+  mode_tt mode;
+  pthread_mutex_t lock;
+  pthread_cond_t job_done;
+} batch_t;
+
+static void *batch_worker(void *data) {
+  batch_t *batch = data;
+
+  pthread_mutex_lock(&batch->lock);
+  while (!batch->stop && batch->next < batch->jobs_nb) {
+    job_t *job = &batch->jobs[batch->next];
+    batch->next++;
+    pthread_mutex_unlock(&batch->lock);
+
+    FILE *buffer = open_memstream(&job->buffer, &job->length);
+    if (buffer == NULL) {
+      warnx("warning: '%s': couldn't allocate the output buffer",
+            job->filename);
+      job->outcome = outcome_invalid;
+    } else {
+      job->outcome = file_solve(job->filename, batch->solve, batch->mode,
+                                buffer, &job->stats);
+      fclose(buffer);
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    job->done = true;
+    pthread_cond_broadcast(&batch->job_done);
+  }
+  pthread_mutex_unlock(&batch->lock);
+
+  grid_pool_release();
+  search_release();
+  return NULL;
+}
+
+/**
+@brief: solves the files on 'jobs' threads, writing their outputs on
+            'output' in the order of the files as soon as they are ready
+@param: char *filenames[], size_t filenames_nb, engine_t solve,
+            const mode_tt mode, FILE *output
+@return: bool (false if a file is invalid, exits if a grid is inconsistent)
+**/
+static bool batch_run(char *filenames[], size_t filenames_nb, engine_t solve,
+                      const mode_tt mode, FILE *output) {
+  batch_t batch;
+  batch.jobs = calloc(filenames_nb, sizeof(job_t));
+  if (batch.jobs == NULL) {
+    errx(EXIT_FAILURE, "error: couldn't allocate the batch!");
+  }
+  for (size_t index = 0; index < filenames_nb; index++) {
+    batch.jobs[index].filename = filenames[index];
+  }
+  batch.jobs_nb = filenames_nb;
+  batch.next = 0;
+  batch.stop = false;
+  batch.solve = solve;
+  batch.mode = mode;
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.job_done, NULL);
+
+  size_t workers_nb = jobs < filenames_nb ? jobs : filenames_nb;
+  pthread_t workers[workers_nb];
+  size_t started = 0;
+  while (started < workers_nb &&
+         pthread_create(&workers[started], NULL, batch_worker, &batch) == 0) {
+    started++;
+  }
+  if (started == 0) {
+    /* No thread at all: this one does the work */
+    batch_worker(&batch);
+  }
+
+  bool valid = true, inconsistent = false;
+  for (size_t index = 0; index < filenames_nb && !inconsistent; index++) {
+    job_t *job = &batch.jobs[index];
+    pthread_mutex_lock(&batch.lock);
+    while (!job->done) {
+      pthread_cond_wait(&batch.job_done, &batch.lock);
+    }
+    if (job->outcome == outcome_inconsistent) {
+      batch.stop = true;
+      inconsistent = true;
+    }
+    pthread_mutex_unlock(&batch.lock);
+
+    if (job->buffer != NULL) {
+      fwrite(job->buffer, 1, job->length, output);
+    }
+    if (job->outcome == outcome_invalid) {
+      valid = false;
+    }
+  }
+
+  for (size_t index = 0; index < started; index++) {
+    pthread_join(workers[index], NULL);
+  }
+
+  if (stats_format != stats_none && !inconsistent) {
+    double walls[filenames_nb];
+    size_t walls_nb = 0;
+    for (size_t index = 0; index < filenames_nb; index++) {
+      if (batch.jobs[index].outcome == outcome_solved) {
+        walls[walls_nb++] = batch.jobs[index].stats.wall_ms;
+      }
+    }
+    latency_summary_print(walls, walls_nb, output);
+  }
+  for (size_t index = 0; index < filenames_nb; index++) {
+    free(batch.jobs[index].buffer);
+  }
+  free(batch.jobs);
+  pthread_cond_destroy(&batch.job_done);
+  pthread_mutex_destroy(&batch.lock);
+
+  if (inconsistent) {
+    errx(EXIT_FAILURE, "error: Grid is inconsistent!");
+  }
+  return valid;
+}
+
 int main(int argc, char *argv[]) {
-  bool all = false, error_handler = false, generator = false, unique = false;
+  bool all = false, error_handler = false, generator = false;
   bool consistency = true;
+  bool fish = false, pipeline_fish = false;
   bool solver = true;
   char *filename = NULL;
   FILE *output = stdout;
   int optc;
   mode_tt mode = mode_first;
+  engine_tt engine = engine_backtrack;
   seed_init(time(NULL));
 
   const struct option l_opts[] = {{"help", no_argument, NULL, 'h'},
                                   {"generate", optional_argument, NULL, 'g'},
+                                  {"fish", optional_argument, NULL, 'f'},
+                                  {"jobs", required_argument, NULL, 'j'},
                                   {"all", no_argument, NULL, 'a'},
+                                  {"count", no_argument, NULL, 'c'},
+                                  {"check-unique", no_argument, NULL, 'U'},
+                                  {"clues", required_argument, NULL, 'C'},
+                                  {"max-solutions", required_argument, NULL,
+                                   'M'},
+                                  {"engine", required_argument, NULL, 'e'},
                                   {"output", required_argument, NULL, 'o'},
+                                  {"order", required_argument, NULL, 'r'},
+                                  {"pipeline", required_argument, NULL, 'p'},
+                                  {"subsets", required_argument, NULL, 's'},
+                                  {"tie-break", required_argument, NULL, 't'},
+                                  {"stats", optional_argument, NULL, 'S'},
                                   {"unique", no_argument, NULL, 'u'},
                                   {"verbose", no_argument, NULL, 'v'},
                                   {"version", no_argument, NULL, 'V'},
                                   {"help", no_argument, NULL, 'h'},
                                   {NULL, 0, NULL, 0}};
 
-  while ((optc = getopt_long(argc, argv, "ag::o:uvVh", l_opts, NULL)) != -1) {
+  while ((optc = getopt_long(argc, argv, "ace:f::g::j:o:p:r:s:t:uvVh", l_opts, NULL)) != -1) {
     switch (optc) {
     case 'a': /* search for all possible solutions */
       all = true;
-      mode = mode_all;
+      if (mode == mode_first) {
+        mode = mode_all;
+      }
+      break;
+
+    case 'c': /* count all the solutions without printing them */
+      all = true;
+      if (mode != mode_unique) {
+        mode = mode_count;
+      }
+      break;
+
+    case 'U': /* tell whether each grid has a unique solution */
+      all = true;
+      mode = mode_unique;
+      break;
+
+    case 'C': /* number of clues of a generated grid */
+    {
+      char *end;
+      clues_wanted = strtoul(optarg, &end, 10);
+      if (clues_wanted == 0 || *end != '\0' || optarg[0] == '-') {
+        errx(EXIT_FAILURE, "error: invalid number of clues '%s'!", optarg);
+      }
+      break;
+    }
+
+    case 'M': /* stop the search after K solutions */
+    {
+      char *end;
+      max_solutions = strtoull(optarg, &end, 10);
+      if (max_solutions == 0 || *end != '\0' || optarg[0] == '-') {
+        errx(EXIT_FAILURE, "error: invalid number of solutions '%s'!",
+             optarg);
+      }
+      break;
+    }
+
+    case 'e': /* select the solver engine */
+      if (strcmp(optarg, "backtrack") == 0) {
+        engine = engine_backtrack;
+      } else if (strcmp(optarg, "dlx") == 0) {
+        engine = engine_dlx;
+      } else if (strcmp(optarg, "cdcl") == 0) {
+        engine = engine_cdcl;
+      } else {
+        errx(EXIT_FAILURE, "error: unknown engine '%s'!", optarg);
+      }
+      break;
+
+    case 'f': /* enable the fish heuristics (default: up to jellyfish) */
+      fish = true;
+      if (optarg == NULL) {
+        grid_fish_enable(GRID_FISH_MAX_ORDER);
+      } else {
+        int order = atoi(optarg);
+        if (order < 2 || order > GRID_FISH_MAX_ORDER) {
+          errx(EXIT_FAILURE, "error: invalid fish order '%s'!", optarg);
+        }
+        grid_fish_enable(order);
+      }
       break;
 
     case 'g': /* generate a grid of size NxN (default: DEFAULT_GRID_SIZE) */
@@ -356,6 +1033,13 @@ int main(int argc, char *argv[]) {
       }
       break;
 
+    case 'j': /* number of threads */
+      jobs = strtoul(optarg, NULL, 10);
+      if (jobs < 1 || jobs > SEARCH_MAX_THREADS) {
+        errx(EXIT_FAILURE, "error: invalid number of threads '%s'!", optarg);
+      }
+      break;
+
     case 'o': /* write output to file */
       filename = optarg;
       if (filename == NULL) {
@@ -363,6 +1047,59 @@ int main(int argc, char *argv[]) {
       }
       break;
 
+    case 'p': /* stages of the heuristics and their scheduling */
+      if (!pipeline_parse(optarg, &pipeline_fish)) {
+        errx(EXIT_FAILURE, "error: invalid pipeline '%s'!", optarg);
+      }
+      break;
+
+    case 'r': /* order of the colors tried by the backtracking */
+      if (strcmp(optarg, "lowest") == 0) {
+        value_order = value_lowest;
+      } else if (strcmp(optarg, "lcv") == 0) {
+        value_order = value_least_constraining;
+      } else if (strcmp(optarg, "frequent") == 0) {
+        value_order = value_most_frequent;
+      } else if (strncmp(optarg, "random", 6) == 0 &&
+                 (optarg[6] == '\0' || optarg[6] == ':')) {
+        value_order = value_random;
+        value_seed = optarg[6] == ':' ? strtoull(&optarg[7], NULL, 10)
+                                      : (uint64_t)time(NULL);
+      } else {
+        errx(EXIT_FAILURE, "error: unknown value order '%s'!", optarg);
+      }
+      break;
+
+    case 's': /* largest naked/hidden subsets looked for */
+    {
+      int order = atoi(optarg);
+      if (order < 2 || order > MAX_COLORS / 2) {
+        errx(EXIT_FAILURE, "error: invalid subset size '%s'!", optarg);
+      }
+      subgrid_subset_limit(order);
+      break;
+    }
+
+    case 't': /* tie-break among the cells with the fewest colors */
+      if (strcmp(optarg, "fewest") == 0) {
+        grid_choice_tie_break(tie_fewest_unsolved);
+      } else if (strcmp(optarg, "most") == 0) {
+        grid_choice_tie_break(tie_most_unsolved);
+      } else {
+        errx(EXIT_FAILURE, "error: unknown tie-break '%s'!", optarg);
+      }
+      break;
+
+    case 'S': /* per file statistics, as text (default) or JSON lines */
+      if (optarg == NULL || strcmp(optarg, "text") == 0) {
+        stats_format = stats_text;
+      } else if (strcmp(optarg, "json") == 0) {
+        stats_format = stats_json;
+      } else {
+        errx(EXIT_FAILURE, "error: unknown statistics format '%s'!", optarg);
+      }
+      break;
+
     case 'u': /* generates a grid with a unique solution */
       unique = true;
       break;
@@ -378,17 +1115,72 @@ int main(int argc, char *argv[]) {
       exit(EXIT_SUCCESS);
 
     case 'h': /* displays sudoku usage help for */
-      printf("\nUsage: sudoku [-a|-o FILE|-v|-V|-h] FILE...\n"
-             "       sudoku -g[SIZE] [-u|-o FILE|-v|-V|-h]\n"
+      printf("\nUsage: sudoku [-a|-c|--max-solutions K|--check-unique|"
+             "-e ENGINE|-f[N]|-j N|-o FILE|\n"
+             "              -p LIST|-r ORDER|-s N|-t TIE|--stats[=FORMAT]|"
+             "-v|-V|-h] FILE...\n"
+             "       sudoku -g[SIZE] [-u|--clues N|-o FILE|-v|-V|-h]\n"
              "Solve or generate Sudoku grids of size: "
              "1, 4, 9, 16, 25, 36, 49, 64 \n\n"
              "-a,--all              search for all possible "
              "solutions\n"
+             "-c,--count            count all the solutions without "
+             "printing them\n"
+             "--max-solutions K     stop '--all' or '--count' after K "
+             "solutions\n"
+             "--check-unique        only tell whether each grid has a "
+             "unique solution\n"
+             "                      (the search stops at the second "
+             "one)\n"
+             "-e ENGINE,--engine ENGINE\n"
+             "                      solver engine: 'backtrack' "
+             "(default), 'dlx' or 'cdcl'\n"
+             "-f[N],--fish[=N]      enable the fish heuristics up to N "
+             "lines (2: x-wing,\n"
+             "                      3: swordfish, 4: jellyfish, "
+             "default: 4)\n"
              "-g[N],--generate[=N]  generate a grid of size NxN "
              "(default: 9)\n"
+             "-j N,--jobs N         solve N files at a time (output "
+             "kept in order), or\n"
+             "                      split the backtracking search of a "
+             "single file on N threads\n"
              "-o FILE,--output FILE write output to FILE\n"
+             "-p LIST,--pipeline LIST\n"
+             "                      run the heuristics in the fixed "
+             "order LIST, among\n"
+             "                      'singles,locked,subsets,fish' "
+             "(singles always first),\n"
+             "                      or 'adaptive' to skip the costly "
+             "stages for a while\n"
+             "                      when they remove nothing (default: "
+             "'singles,locked,\n"
+             "                      subsets,fish')\n"
+             "-r ORDER,--order ORDER\n"
+             "                      order of the colors tried by "
+             "'backtrack': 'lowest'\n"
+             "                      (default), 'lcv', 'frequent' or "
+             "'random[:SEED]'\n"
+             "-s N,--subsets N      look for naked and hidden subsets "
+             "of up to N cells\n"
+             "                      (default: 4)\n"
+             "-t TIE,--tie-break TIE\n"
+             "                      branch among the cells with the "
+             "fewest colors on the\n"
+             "                      one with the 'fewest' (default) or "
+             "'most' unsolved\n"
+             "                      cells in its units\n"
+             "--stats[=FORMAT]      print the statistics of each file, "
+             "and a latency\n"
+             "                      summary for several files, as 'text' "
+             "(default) or\n"
+             "                      'json' (one object per line)\n"
              "-u,--unique           generate a grid with unique "
              "solution\n"
+             "--clues N             number of clues of a generated grid "
+             "(default: 75\n"
+             "                      percent of the cells), as close as "
+             "possible with '-u'\n"
              "-v,--verbose          verbose output\n"
              "-V,--version          display version and exit\n"
              "-h,--help             display this help and exit\n\n");
@@ -401,6 +1193,11 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  /* A fixed pipeline naming the fish stage enables it */
+  if (pipeline_fish && !fish) {
+    grid_fish_enable(GRID_FISH_MAX_ORDER);
+  }
+
   if (filename != NULL) {
     output = fopen(filename, "a");
     if (output == NULL) {
@@ -412,6 +1209,7 @@ int main(int argc, char *argv[]) {
   if (solver) {
     if (unique) {
       error_handler = true;
+      unique = false;
       warnx("error: option 'unique' conflicts with solver mode, "
             "disabling it!");
     }
@@ -421,41 +1219,37 @@ int main(int argc, char *argv[]) {
       errx(EXIT_FAILURE, "error: no input grid given!");
     }
 
-    for (int i = optind; i < argc; i++) {
-      fprintf(output, "====================%s====================\n\n",
-              argv[i]);
-      grid_t *grid_test = file_parser(argv[i]);
-      if (grid_test == NULL) {
+    engine_t solve = backtrack;
+    if (engine == engine_dlx) {
+      solve = dlx_engine;
+    } else if (engine == engine_cdcl) {
+      solve = cdcl_engine;
+    }
+
+    if (optind + 1 < argc && jobs > 1) {
+      /* Files are solved concurrently, each search on a single thread */
+      search_threads = 1;
+      if (!batch_run(&argv[optind], argc - optind, solve, mode, output)) {
         error_handler = true;
-      } else {
-        fprintf(output, "Initial grid:\n");
-        grid_print(grid_test, output);
-        if (!grid_is_consistent(grid_test)) {
-          grid_free(grid_test);
+      }
+    } else {
+      search_threads = jobs;
+      double walls[argc - optind];
+      size_t walls_nb = 0;
+      for (int i = optind; i < argc; i++) {
+        file_stats_t stats;
+        outcome_tt outcome = file_solve(argv[i], solve, mode, output, &stats);
+        if (outcome == outcome_inconsistent) {
           errx(EXIT_FAILURE, "error: Grid is inconsistent!");
         }
-        grid_test = backtrack(grid_test, mode, output);
-        if (mode == mode_all) {
-
-          if (solutions == 0) {
-            grid_free(grid_test);
-            errx(EXIT_FAILURE, "error: Grid is inconsistent!");
-          }
-          fprintf(output, "There are '%d' solutions\n\n", solutions);
-          solutions = 0;
+        if (outcome == outcome_invalid) {
+          error_handler = true;
+        } else {
+          walls[walls_nb++] = stats.wall_ms;
         }
-
-        if (mode == mode_first) {
-          grid_test = backtrack(grid_test, mode, output);
-          if (grid_test != NULL) {
-            fprintf(output, "Solved grid:\n");
-            grid_print(grid_test, output);
-          } else {
-            grid_free(grid_test);
-            errx(EXIT_FAILURE, "error: Grid is inconsistent!");
-          }
-        }
-        grid_free(grid_test);
+      }
+      if (stats_format != stats_none && walls_nb > 1) {
+        latency_summary_print(walls, walls_nb, output);
       }
     }
   }
@@ -470,13 +1264,31 @@ int main(int argc, char *argv[]) {
             "~~~~~~~~~~~~~ Generator ~~~~~~~~~~~~~\n\n"
             "Generating a grid of size: %d\n",
             grid_size);
-    grid_t *grid = grid_generator(grid_size, output);
+    size_t cells_nb = (size_t)grid_size * grid_size;
+    size_t clues = clues_wanted != 0 ? clues_wanted : cells_nb * FILLING_RATE;
+    if (clues > cells_nb) {
+      errx(EXIT_FAILURE, "error: a grid of size %d has only %zu cells!",
+           grid_size, cells_nb);
+    }
+    size_t clues_left;
+    grid_t *grid = grid_generator(grid_size, clues, &clues_left, output);
+    if (grid == NULL) {
+      errx(EXIT_FAILURE, "error: couldn't generate a grid!");
+    }
+    if (clues_left > clues) {
+      warnx("warning: no grid with a unique solution found with %zu clues, "
+            "the closest has %zu",
+            clues, clues_left);
+    }
     grid_print(grid, output);
     fprintf(output, "Filling rate: %0.1f percent.\n\n",
-            FILLING_RATE * PERCENT_CONV);
+            (double)clues_left / cells_nb * PERCENT_CONV);
     grid_free(grid);
   }
 
+  grid_pool_release();
+  search_release();
+
   if (output != stdout) {
     fclose(output);
   }
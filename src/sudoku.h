@@ -6,10 +6,28 @@
 #define REVISION 0
 
 #define DEFAULT_GRID_SIZE 9
-#define FILLING_RATE 0.75
+#define FILLING_RATE 0.75   /* default share of clues of a generated grid */
+#define GENERATOR_ATTEMPTS 8 /* solved grids dug before giving up a target */
 #define MAX_GRID_SIZE 64
 #define PERCENT_CONV 100
 
-typedef enum { mode_first, mode_all } mode_tt;
+typedef enum {
+  mode_first,
+  mode_all,  /* prints every solution, then their number */
+  mode_count, /* only the number of solutions */
+  mode_unique /* whether there is a unique solution */
+} mode_tt;
+
+typedef enum { engine_backtrack, engine_dlx, engine_cdcl } engine_tt;
+
+typedef enum { stats_none, stats_text, stats_json } stats_tt;
+
+#define STATS_HISTOGRAM_BUCKETS 16 /* < 1 ms, < 2 ms, ... , 16384 ms or more */
+
+typedef enum {
+  outcome_solved,
+  outcome_invalid,     /* the file couldn't be parsed */
+  outcome_inconsistent /* the grid has no solution */
+} outcome_tt;
 
 #endif /* SUDOKU_H */
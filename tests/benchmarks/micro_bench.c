@@ -0,0 +1,324 @@
+#define _DEFAULT_SOURCE
+
+#include <glob.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define BENCH_CYCLES /* time stamp counter (reference cycles) */
+#endif
+
+#include "../../include/colors.h"
+#include "../../include/grid.h"
+
+/* Microbenchmarks of the colors and grid primitives, on the last grid of
+ * each size found in the challenge levels (the hardest level that has one),
+ * propagated once so that the cells look like the ones met during a
+ * search. Each primitive is run in
+ * batches until BENCH_MIN_NS have elapsed, the clock being read once per
+ * slice of batches lasting BENCH_SLICE_NS at least; the time spent
+ * restoring the inputs between two calls is measured alone and subtracted. */
+
+#define BENCH_MIN_NS 20000000ULL /* duration of a measure */
+#define BENCH_SLICE_NS 100000ULL /* time between two clock reads */
+#define BENCH_LEVELS "%s/level-0*/grid-%02zux%02zu-*.sku"
+
+/* Input of the benchmarks: a propagated grid and its units */
+typedef struct {
+  grid_t *grid;
+  size_t size;
+  size_t units_nb;
+  colors_t *cells;    /* size * size cells, row-major */
+  colors_t *units;    /* units_nb * size cells, unit by unit */
+  colors_t *scratch;  /* copy of a unit the heuristics work on */
+  colors_t **subgrid; /* pointers to the scratch cells */
+} input_t;
+
+typedef bool (*heuristic_fn_t)(colors_t *subgrid[], size_t size);
+
+static volatile uint64_t sink; /* keeps the results alive */
+
+/* Timers */
+
+static uint64_t now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t now_cycles(void) {
+#ifdef BENCH_CYCLES
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+/* Result of a measure, per operation */
+typedef struct {
+  double ns;
+  double cycles;
+} measure_t;
+
+/* Runs 'batch' (which performs 'ops' operations per call) until
+ * BENCH_MIN_NS have elapsed, in slices of 'repeat' calls long enough for
+ * the clock reads not to count */
+static measure_t measure(void (*batch)(input_t *, const void *),
+                         input_t *input, const void *arg, const size_t ops) {
+  size_t repeat = 1;
+  for (;;) {
+    uint64_t start = now_ns();
+    for (size_t call = 0; call < repeat; call++) {
+      batch(input, arg);
+    }
+    if (now_ns() - start >= BENCH_SLICE_NS) {
+      break;
+    }
+    repeat *= 2;
+  }
+
+  size_t rounds = 0;
+  uint64_t start = now_ns(), start_cycles = now_cycles(), elapsed = 0;
+  while (elapsed < BENCH_MIN_NS) {
+    for (size_t call = 0; call < repeat; call++) {
+      batch(input, arg);
+    }
+    rounds += repeat;
+    elapsed = now_ns() - start;
+  }
+  double total = (double)rounds * ops;
+  measure_t result = {elapsed / total, (now_cycles() - start_cycles) / total};
+  return result;
+}
+
+static void report(const size_t size, const char *name, measure_t op,
+                   const measure_t overhead) {
+  op.ns -= overhead.ns;
+  op.cycles -= overhead.cycles;
+  if (op.ns < 0) {
+    op.ns = 0;
+  }
+  if (op.cycles < 0) {
+    op.cycles = 0;
+  }
+#ifdef BENCH_CYCLES
+  printf("%4zu  %-26s %12.1f %12.1f\n", size, name, op.ns, op.cycles);
+#else
+  printf("%4zu  %-26s %12.1f %12s\n", size, name, op.ns, "-");
+#endif
+}
+
+/* Inputs */
+
+/* Loads a grid file: '#' starts a comment, blanks are skipped and the
+ * first row gives the size */
+static grid_t *grid_load(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    return NULL;
+  }
+
+  char cells[MAX_GRID_SIZE * MAX_GRID_SIZE];
+  size_t cells_nb = 0, size = 0;
+  int c;
+  while ((c = fgetc(file)) != EOF && cells_nb < sizeof(cells)) {
+    if (c == '#') {
+      while (c != '\n' && c != EOF) {
+        c = fgetc(file);
+      }
+    }
+    if (c == '\n' && size == 0) {
+      size = cells_nb;
+    } else if (c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != EOF) {
+      cells[cells_nb++] = c;
+    }
+  }
+  fclose(file);
+
+  if (!grid_check_size(size) || cells_nb != size * size) {
+    return NULL;
+  }
+  grid_t *grid = grid_alloc(size);
+  for (size_t cell = 0; grid != NULL && cell < cells_nb; cell++) {
+    grid_set_cell(grid, cell / size, cell % size, cells[cell]);
+  }
+  return grid;
+}
+
+static bool input_load(input_t *input, const char *directory,
+                       const size_t size) {
+  char pattern[FILENAME_MAX];
+  snprintf(pattern, sizeof(pattern), BENCH_LEVELS, directory, size, size);
+  glob_t files;
+  if (glob(pattern, 0, NULL, &files) != 0) {
+    return false;
+  }
+  input->grid = grid_load(files.gl_pathv[files.gl_pathc - 1]);
+  globfree(&files);
+  if (input->grid == NULL ||
+      grid_heuristics(input->grid) == grid_inconsistent) {
+    grid_free(input->grid);
+    input->grid = NULL;
+    return false;
+  }
+
+  const grid_tables_t *tables = grid_tables(size);
+  input->size = size;
+  input->units_nb = tables->units_nb;
+  input->cells = malloc(size * size * sizeof(colors_t));
+  input->units = malloc(tables->units_nb * size * sizeof(colors_t));
+  input->scratch = malloc(size * sizeof(colors_t));
+  input->subgrid = malloc(size * sizeof(colors_t *));
+  if (input->cells == NULL || input->units == NULL ||
+      input->scratch == NULL || input->subgrid == NULL) {
+    return false;
+  }
+  for (size_t cell = 0; cell < size * size; cell++) {
+    input->cells[cell] = get_grid_color(input->grid, cell / size, cell % size);
+  }
+  for (size_t unit = 0; unit < tables->units_nb; unit++) {
+    const uint16_t *cells = grid_tables_unit(tables, unit);
+    for (size_t index = 0; index < size; index++) {
+      input->units[unit * size + index] = input->cells[cells[index]];
+    }
+  }
+  for (size_t index = 0; index < size; index++) {
+    input->subgrid[index] = &input->scratch[index];
+  }
+  return true;
+}
+
+static void input_free(input_t *input) {
+  grid_free(input->grid);
+  free(input->cells);
+  free(input->units);
+  free(input->scratch);
+  free(input->subgrid);
+}
+
+/* Batches */
+
+static void batch_colors_count(input_t *input, const void *arg) {
+  (void)arg;
+  size_t total = 0;
+  for (size_t cell = 0; cell < input->size * input->size; cell++) {
+    total += colors_count(input->cells[cell]);
+  }
+  sink += total;
+}
+
+static void batch_colors_random(input_t *input, const void *arg) {
+  (void)arg;
+  colors_t total = 0;
+  for (size_t cell = 0; cell < input->size * input->size; cell++) {
+    total ^= colors_random(input->cells[cell]);
+  }
+  sink += total;
+}
+
+/* Restores every unit in turn, as the heuristic batches do */
+static void batch_unit_restore(input_t *input, const void *arg) {
+  (void)arg;
+  for (size_t unit = 0; unit < input->units_nb; unit++) {
+    memcpy(input->scratch, &input->units[unit * input->size],
+           input->size * sizeof(colors_t));
+    sink += input->scratch[0];
+  }
+}
+
+static void batch_heuristic(input_t *input, const void *arg) {
+  heuristic_fn_t heuristic = *(const heuristic_fn_t *)arg;
+  for (size_t unit = 0; unit < input->units_nb; unit++) {
+    memcpy(input->scratch, &input->units[unit * input->size],
+           input->size * sizeof(colors_t));
+    sink += heuristic(input->subgrid, input->size);
+  }
+}
+
+static void batch_grid_copy(input_t *input, const void *arg) {
+  (void)arg;
+  grid_free(grid_copy(input->grid));
+}
+
+static void batch_subgrid_apply(input_t *input, const void *arg) {
+  heuristic_fn_t heuristic = *(const heuristic_fn_t *)arg;
+  grid_t *copy = grid_copy(input->grid);
+  sink += subgrid_apply(copy, heuristic);
+  grid_free(copy);
+}
+
+static void batch_grid_is_consistent(input_t *input, const void *arg) {
+  (void)arg;
+  sink += grid_is_consistent(input->grid);
+}
+
+static void batch_grid_choice(input_t *input, const void *arg) {
+  (void)arg;
+  sink += grid_choice(input->grid).color;
+}
+
+int main(int argc, char *argv[]) {
+  const char *directory = argc > 1 ? argv[1] : "challenges";
+  static const size_t sizes[] = {1, 4, 9, 16, 25, 36, 49, 64};
+  static const struct {
+    const char *name;
+    heuristic_fn_t heuristic;
+  } heuristics[] = {{"cross_hatching_heuristic", cross_hatching_heuristic},
+                    {"lone_number_heuristic", lone_number_heuristic},
+                    {"naked_subset_heuristic", naked_subset_heuristic},
+                    {"hidden_subset_heuristic", hidden_subset_heuristic},
+                    {"subgrid_heuristics", subgrid_heuristics}};
+  const size_t heuristics_nb = sizeof(heuristics) / sizeof(heuristics[0]);
+  const measure_t none = {0, 0};
+
+  srand(1);
+  printf("size  %-26s %12s %12s\n", "operation", "ns/op", "cycles/op");
+  for (size_t index = 0; index < sizeof(sizes) / sizeof(sizes[0]); index++) {
+    size_t size = sizes[index];
+    input_t input;
+    memset(&input, 0, sizeof(input));
+    if (!input_load(&input, directory, size)) {
+      fprintf(stderr, "warning: no grid of size %zu in '%s'\n", size,
+              directory);
+      input_free(&input);
+      continue;
+    }
+    size_t cells_nb = size * size;
+
+    report(size, "colors_count",
+           measure(batch_colors_count, &input, NULL, cells_nb), none);
+    report(size, "colors_random",
+           measure(batch_colors_random, &input, NULL, cells_nb), none);
+
+    /* Per unit, the unit being restored before each call */
+    measure_t restore =
+        measure(batch_unit_restore, &input, NULL, input.units_nb);
+    for (size_t heuristic = 0; heuristic < heuristics_nb; heuristic++) {
+      report(size, heuristics[heuristic].name,
+             measure(batch_heuristic, &input, &heuristics[heuristic].heuristic,
+                     input.units_nb),
+             restore);
+    }
+
+    /* Per grid, on a copy of the grid */
+    measure_t copy = measure(batch_grid_copy, &input, NULL, 1);
+    report(size, "grid_copy", copy, none);
+    heuristic_fn_t apply = subgrid_heuristics;
+    report(size, "subgrid_apply",
+           measure(batch_subgrid_apply, &input, &apply, 1), copy);
+    report(size, "grid_is_consistent",
+           measure(batch_grid_is_consistent, &input, NULL, 1), none);
+    report(size, "grid_choice",
+           measure(batch_grid_choice, &input, NULL, 1), none);
+
+    input_free(&input);
+  }
+
+  grid_pool_release();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,194 @@
+#!/bin/sh
+
+# Per-grid benchmark of the challenge levels: every grid is solved RUNS
+# times with '--count --stats=json' (a timed out grid is not run again), and
+# the min, median and 95th percentile of the wall times reported by the
+# solver are saved as JSON, one grid per line. Given a baseline saved by a
+# previous run, grids slower by more than THRESHOLD percent (and 1 ms),
+# with another number of solutions or timing out are flagged, and the
+# script exits with 1. The baseline may be the output file itself: it is
+# only replaced once the comparison is done.
+
+BINARY=../../sudoku
+RUNS=3
+TIMEOUT=10
+OUTPUT=bench.json
+BASELINE=
+THRESHOLD=10
+LEVELS=
+
+usage() {
+    echo "Usage: $(basename $0) [-b BINARY] [-r RUNS] [-t TIMEOUT] [-o OUTPUT]"
+    echo "                   [-c BASELINE] [-x THRESHOLD] [LEVEL...]"
+    echo ""
+    echo "-b BINARY    solver to benchmark (default: ${BINARY})"
+    echo "-r RUNS      runs per grid (default: ${RUNS})"
+    echo "-t TIMEOUT   seconds allowed per run (default: ${TIMEOUT})"
+    echo "-o OUTPUT    JSON results (default: ${OUTPUT})"
+    echo "-c BASELINE  JSON results to compare with"
+    echo "-x THRESHOLD slowdown flagged as a regression, in percent"
+    echo "             (default: ${THRESHOLD})"
+    echo "LEVEL...     level directories (default: all of them)"
+}
+
+while getopts "b:r:t:o:c:x:h" option; do
+    case "${option}" in
+	b) BINARY="${OPTARG}" ;;
+	r) RUNS="${OPTARG}" ;;
+	t) TIMEOUT="${OPTARG}" ;;
+	o) OUTPUT="${OPTARG}" ;;
+	c) BASELINE="${OPTARG}" ;;
+	x) THRESHOLD="${OPTARG}" ;;
+	h) usage; exit 0 ;;
+	*) usage; exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+LEVELS="$*"
+if [ -z "${LEVELS}" ]; then
+    LEVELS=$(ls -d level-*)
+fi
+
+if [ ! -x "${BINARY}" ]; then
+    echo "error: '${BINARY}' is not executable" >&2
+    exit 2
+fi
+
+# Prints the value of a numeric field of a JSON line
+json_field() {
+    sed -n "s/.*\"$1\":\([0-9.]*\).*/\1/p"
+}
+
+results=$(mktemp)
+output=$(mktemp)
+json=$(mktemp)
+trap 'rm -f ${results} ${output} ${json}' EXIT
+
+printf "%-28s %-7s %10s %10s %10s %10s %10s\n" \
+       grid status min_ms median_ms p95_ms nodes solutions
+for level in ${LEVELS}; do
+    for grid in ${level}/*.sku; do
+	status=ok
+	walls=
+	nodes=0
+	solutions=0
+	run=0
+	while [ ${run} -lt ${RUNS} ] && [ "${status}" = ok ]; do
+	    timeout ${TIMEOUT} ${BINARY} --count --stats=json ${grid} \
+		    > ${output} 2>/dev/null
+	    ret=$?
+	    line=$(grep '^{"file"' ${output})
+	    if [ ${ret} -ne 0 ] || [ -z "${line}" ]; then
+		status=error
+		[ ${ret} -eq 124 ] && status=timeout
+		break
+	    fi
+	    walls="${walls} $(echo "${line}" | json_field wall_ms)"
+	    nodes=$(echo "${line}" | json_field nodes)
+	    solutions=$(echo "${line}" | json_field solutions)
+	    run=$((run + 1))
+	done
+
+	# Nearest rank percentiles of the sorted wall times
+	stats=$(echo ${walls} | tr ' ' '\n' | sort -g | awk '
+	    NF { wall[++n] = $1 }
+	    END {
+		if (n == 0) { print "null null null"; exit }
+		p95 = int(0.95 * n); if (p95 < 0.95 * n) p95++
+		printf "%.3f %.3f %.3f\n", wall[1], wall[int((n + 1) / 2)],
+		       wall[p95]
+	    }')
+	set -- ${stats}
+	printf "%-28s %-7s %10s %10s %10s %10s %10s\n" \
+	       "${grid}" ${status} $1 $2 $3 ${nodes} ${solutions}
+	printf '{"grid":"%s","status":"%s","runs":%d,"min_ms":%s,"median_ms":%s,"p95_ms":%s,"nodes":%s,"solutions":%s}\n' \
+	       "${grid}" ${status} ${run} $1 $2 $3 ${nodes} ${solutions} \
+	       >> ${results}
+    done
+done
+
+{
+    printf '{"binary":"%s","runs":%d,"timeout":%d,"grids":[\n' \
+	   "${BINARY}" ${RUNS} ${TIMEOUT}
+    sed '$!s/$/,/' ${results}
+    printf ']}\n'
+} > ${json}
+
+# Saves the results, after the comparison (if any) as the baseline may be
+# the previous output
+save() {
+    if ! cp ${json} "${OUTPUT}"; then
+	echo "error: can't write '${OUTPUT}'" >&2
+	exit 2
+    fi
+    echo ""
+    echo "Results saved in ${OUTPUT}"
+}
+
+if [ -z "${BASELINE}" ]; then
+    save
+    exit 0
+fi
+if [ ! -r "${BASELINE}" ]; then
+    echo "error: can't read baseline '${BASELINE}'" >&2
+    save
+    exit 2
+fi
+
+echo ""
+echo "Comparison with ${BASELINE} (threshold: ${THRESHOLD}%)"
+echo "====================="
+awk -v threshold=${THRESHOLD} '
+    function field(line, name,    value) {
+	if (match(line, "\"" name "\":\"?[^,\"}]*")) {
+	    value = substr(line, RSTART, RLENGTH)
+	    sub("\"" name "\":\"?", "", value)
+	    return value
+	}
+	return ""
+    }
+    /"grid":/ {
+	grid = field($0, "grid")
+	if (FILENAME == ARGV[1]) {
+	    base_status[grid] = field($0, "status")
+	    base_median[grid] = field($0, "median_ms") + 0
+	    base_solutions[grid] = field($0, "solutions")
+	    next
+	}
+	if (!(grid in base_status)) {
+	    next
+	}
+	compared++
+	status = field($0, "status")
+	median = field($0, "median_ms") + 0
+	if (status != "ok" && base_status[grid] == "ok") {
+	    printf "REGRESSION %s: %s (was ok)\n", grid, status
+	    regressions++
+	} else if (status == "ok" && base_status[grid] == "ok" &&
+		   field($0, "solutions") != base_solutions[grid]) {
+	    printf "REGRESSION %s: %s solution(s) (was %s)\n", grid,
+		   field($0, "solutions"), base_solutions[grid]
+	    regressions++
+	} else if (status == "ok" && base_status[grid] == "ok" &&
+		   median > base_median[grid] * (1 + threshold / 100) &&
+		   median - base_median[grid] > 1) {
+	    printf "REGRESSION %s: %.3f ms (was %.3f ms, +%.0f%%)\n", grid,
+		   median, base_median[grid],
+		   100 * (median / base_median[grid] - 1)
+	    regressions++
+	} else if (status == "ok" && base_status[grid] != "ok") {
+	    printf "improved   %s: ok (was %s)\n", grid, base_status[grid]
+	}
+	if (status == "ok" && base_status[grid] == "ok") {
+	    total += median
+	    base_total += base_median[grid]
+	}
+    }
+    END {
+	printf "%d grid(s) compared, %d regression(s), median total %.3f ms " \
+	       "(was %.3f ms)\n", compared, regressions, total, base_total
+	exit (regressions > 0)
+    }' "${BASELINE}" ${json}
+status=$?
+save
+exit ${status}
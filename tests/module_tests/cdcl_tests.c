@@ -0,0 +1,181 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "../../include/cdcl.h"
+#include "../../include/colors.h"
+#include "../../include/grid.h"
+
+/* gcc -I ../include -c cdcl_tests.c */
+/* gcc -o cdcl_tests cdcl_tests.o cdcl.o grid.o colors.o arena.o */
+
+void EXPECT(bool test, char *fmt, ...) {
+  fprintf(stdout, "Checking '");
+
+  va_list vargs;
+  va_start(vargs, fmt);
+  vprintf(fmt, vargs);
+  va_end(vargs);
+
+  if (test)
+    fprintf(stdout, "': (passed)\n");
+  else
+    fprintf(stdout, "': (failed!)\n");
+}
+
+/* Solutions seen by on_solution, which stops the search at 'limit' (0 for
+ * no limit) */
+typedef struct {
+  size_t found;
+  size_t limit;
+  bool valid;     /* every solution is a solved, consistent grid */
+  grid_t *first;  /* copy of the first solution */
+} collect_t;
+
+static bool on_solution(const grid_t *solution, void *data) {
+  collect_t *collect = data;
+  collect->found++;
+  grid_t *copy = grid_copy(solution);
+  collect->valid &=
+      copy != NULL && grid_is_solved(copy) && grid_is_consistent(copy);
+  if (collect->first == NULL) {
+    collect->first = copy;
+  } else {
+    grid_free(copy);
+  }
+  return collect->limit == 0 || collect->found < collect->limit;
+}
+
+/* Runs the search, without building the solutions if 'collect' is NULL */
+static size_t cdcl_count(const grid_t *grid, collect_t *collect,
+                         cdcl_stats_t *stats) {
+  cdcl_t *cdcl = cdcl_alloc(grid);
+  size_t solutions = cdcl_search(cdcl, collect != NULL ? on_solution : NULL,
+                                 collect);
+  bool failed = cdcl_failed(cdcl);
+  if (stats != NULL) {
+    *stats = cdcl_stats(cdcl);
+  }
+  cdcl_free(cdcl);
+  return failed ? 0 : solutions;
+}
+
+/* Checks a solution against the expected cells, one char per cell */
+static bool is_solution(const grid_t *grid, const char *expected) {
+  size_t size = grid_get_size(grid);
+  bool same = grid != NULL;
+  for (size_t cell = 0; same && cell < size * size; ++cell) {
+    char *colors = grid_get_cell(grid, cell / size, cell % size);
+    same = colors[0] == expected[cell] && colors[1] == '\0';
+    free(colors);
+  }
+  return same;
+}
+
+int main(void) {
+  /* Testing NULLs */
+  fputs("Testing NULL solvers\n"
+        "====================\n",
+        stdout);
+
+  EXPECT((cdcl_alloc(NULL) == NULL), "cdcl_alloc(NULL) == NULL");
+  EXPECT((cdcl_search(NULL, NULL, NULL) == 0),
+         "cdcl_search(NULL, NULL, NULL) == 0");
+  EXPECT((cdcl_stats(NULL).decisions == 0), "cdcl_stats(NULL).decisions == 0");
+  cdcl_free(NULL);
+  EXPECT((true), "cdcl_free(NULL)");
+
+  fputs("\n", stdout);
+
+  /* Testing the solution counts */
+  fputs("Testing cdcl_search()\n"
+        "=====================\n",
+        stdout);
+
+  /* A solved 4x4 grid, then with its diagonal emptied (still unique) */
+  static const char solved[] = "1234"
+                               "3412"
+                               "2143"
+                               "4321";
+  grid_t *unique = grid_alloc(4), *empty = grid_alloc(4);
+  grid_t *none = grid_alloc(4);
+  for (size_t cell = 0; cell < 16; ++cell)
+    if (cell / 4 != cell % 4)
+      grid_set_cell(unique, cell / 4, cell % 4, solved[cell]);
+  grid_set_cell(none, 0, 0, '1');
+  grid_set_cell(none, 0, 1, '1');
+
+  collect_t collect = {0, 0, true, NULL};
+  EXPECT((cdcl_count(unique, &collect, NULL) == 1 && collect.found == 1 &&
+          collect.valid && is_solution(collect.first, solved)),
+         "cdcl_search(4x4 with a unique solution) == 1");
+  grid_free(collect.first);
+
+  /* A 9x9 grid with 21 clues, too hard for propagation alone: the search
+   * has to learn from its conflicts */
+  static const char hard[] = "800000000003600000070090200"
+                             "050007000000045700000100030"
+                             "001000068008500010090000400";
+  static const char hard_solved[] = "812753649943682175675491283"
+                                    "154237896369845721287169534"
+                                    "521974368438526917796318452";
+  grid_t *clues = grid_alloc(9);
+  for (size_t cell = 0; cell < 81; ++cell)
+    if (hard[cell] != '0')
+      grid_set_cell(clues, cell / 9, cell % 9, hard[cell]);
+  cdcl_stats_t stats;
+  collect = (collect_t){0, 0, true, NULL};
+  EXPECT((cdcl_count(clues, &collect, &stats) == 1 && collect.valid &&
+          is_solution(collect.first, hard_solved)),
+         "cdcl_search(hard 9x9) == 1, the known solution");
+  EXPECT((stats.conflicts > 0 && stats.learned > 0),
+         "cdcl_search(hard 9x9) learns from its conflicts");
+  grid_free(collect.first);
+
+  /* Every solution found is blocked before the search goes on */
+  collect = (collect_t){0, 0, true, NULL};
+  EXPECT((cdcl_count(empty, &collect, NULL) == 288 && collect.found == 288 &&
+          collect.valid),
+         "cdcl_search(empty 4x4) == 288, all of them solved");
+  grid_free(collect.first);
+  EXPECT((cdcl_count(empty, NULL, NULL) == 288),
+         "cdcl_search(empty 4x4, NULL) == 288");
+
+  /* Stopped by the callback, as with --max-solutions */
+  collect = (collect_t){0, 5, true, NULL};
+  EXPECT((cdcl_count(empty, &collect, NULL) == 5 && collect.found == 5),
+         "cdcl_search(empty 4x4) stops after 5 solutions");
+  grid_free(collect.first);
+
+  collect = (collect_t){0, 0, true, NULL};
+  EXPECT((cdcl_count(none, &collect, NULL) == 0 && collect.found == 0),
+         "cdcl_search(inconsistent 4x4) == 0");
+
+  /* '1' only fits in columns 2 and 6 of rows 1, 5 and 9: no solution, though
+   * every cell keeps colors */
+  grid_t *crowded = grid_alloc(9);
+  for (size_t row = 0; row < 9; row += 4)
+    for (size_t col = 0; col < 9; ++col)
+      if (col != 1 && col != 5)
+        grid_choice_discard(crowded, (choice_t){row, col, colors_set(0)});
+  EXPECT((cdcl_count(crowded, NULL, NULL) == 0),
+         "cdcl_search(3 rows with 2 places for '1') == 0");
+
+  char *cell = grid_get_cell(empty, 0, 0);
+  EXPECT((strlen(cell) == 4), "cdcl_alloc() leaves the grid untouched");
+  free(cell);
+
+  grid_free(unique);
+  grid_free(empty);
+  grid_free(none);
+  grid_free(clues);
+  grid_free(crowded);
+  grid_pool_release();
+
+  return EXIT_SUCCESS;
+}
@@ -594,6 +594,70 @@ int main(void) {
 
   fputs("\n", stdout);
 
+  /* Testing colors_index and colors_last_index */
+  /***********************************************/
+  fputs("colors_index/colors_last_index\n"
+        "==============================\n",
+        stdout);
+
+  EXPECT((colors_index(p0) == 1), "colors_index ([1,2,3,5,7,27,60]) == 1");
+  EXPECT((colors_last_index(p0) == 60),
+         "colors_last_index ([1,2,3,5,7,27,60]) == 60");
+  EXPECT((colors_index(colors_set(0)) == 0 &&
+          colors_last_index(colors_set(0)) == 0),
+         "colors_index ([0]) == colors_last_index ([0]) == 0");
+  EXPECT((colors_index(colors_set(63)) == 63 &&
+          colors_last_index(colors_set(63)) == 63),
+         "colors_index ([63]) == colors_last_index ([63]) == 63");
+  EXPECT((colors_index(colors_full(64)) == 0 &&
+          colors_last_index(colors_full(64)) == 63),
+         "colors_index/colors_last_index ([0, ... ,63]) == 0/63");
+
+  fputs("\n", stdout);
+
+  /* Testing colors_pop */
+  /**********************/
+  fputs("colors_pop\n"
+        "==========\n",
+        stdout);
+
+  colors_t popped = p0;
+  size_t indexes[7], indexes_nb = 0;
+  while (popped != colors_empty() && indexes_nb < 7)
+    indexes[indexes_nb++] = colors_pop(&popped);
+  EXPECT((indexes_nb == 7 && popped == colors_empty() && indexes[0] == 1 &&
+          indexes[3] == 5 && indexes[6] == 60),
+         "colors_pop ([1,2,3,5,7,27,60]) == 1, 2, 3, 5, 7, 27, 60");
+
+  popped = colors_set(63);
+  EXPECT((colors_pop(&popped) == 63 && popped == colors_empty()),
+         "colors_pop ([63]) == 63, leaving []");
+
+  fputs("\n", stdout);
+
+  /* Testing colors_select */
+  /*************************/
+  fputs("colors_select\n"
+        "=============\n",
+        stdout);
+
+  EXPECT((colors_select(p0, 0) == colors_set(1)),
+         "colors_select ([1,2,3,5,7,27,60], 0) == [1]");
+  EXPECT((colors_select(p0, 4) == colors_set(7)),
+         "colors_select ([1,2,3,5,7,27,60], 4) == [7]");
+  EXPECT((colors_select(p0, 6) == colors_set(60)),
+         "colors_select ([1,2,3,5,7,27,60], 6) == [60]");
+  EXPECT((colors_select(p0, 7) == colors_empty()),
+         "colors_select ([1,2,3,5,7,27,60], 7) == []");
+  EXPECT((colors_select(colors_full(64), 63) == colors_set(63)),
+         "colors_select ([0, ... ,63], 63) == [63]");
+  EXPECT((colors_select(colors_full(64), 64) == colors_empty()),
+         "colors_select ([0, ... ,63], 64) == []");
+  EXPECT((colors_select(colors_empty(), 0) == colors_empty()),
+         "colors_select ([], 0) == []");
+
+  fputs("\n", stdout);
+
   /* Testing colors_random */
   /*************************/
   fputs("colors_random\n"
@@ -625,5 +689,48 @@ int main(void) {
 
   fputs("\n", stdout);
 
+  /* Testing naked_subset_heuristic and hidden_subset_heuristic */
+  /**************************************************************/
+  fputs("subset heuristics\n"
+        "=================\n",
+        stdout);
+
+  /* Naked triple: [0,1] [1,2] [0,2] own the colors 0, 1 and 2 */
+  colors_t unit[9];
+  colors_t *cells[9];
+  for (size_t index = 0; index < 9; index++) {
+    unit[index] = colors_full(9);
+    cells[index] = &unit[index];
+  }
+  unit[0] = colors_add(colors_set(0), 1);
+  unit[4] = colors_add(colors_set(1), 2);
+  unit[8] = colors_add(colors_set(0), 2);
+
+  EXPECT(naked_subset_heuristic(cells, 9),
+         "naked_subset_heuristic (triple) == true");
+  EXPECT((unit[1] == colors_subtract(colors_full(9), colors_full(3))),
+         "naked_subset_heuristic (triple): [0,1,2] removed from the others");
+  EXPECT((unit[4] == colors_add(colors_set(1), 2)),
+         "naked_subset_heuristic (triple): [1,2] left untouched");
+  EXPECT(!naked_subset_heuristic(cells, 9),
+         "naked_subset_heuristic (triple applied) == false");
+
+  /* Hidden pair: the colors 7 and 8 only fit in the cells 2 and 5 */
+  for (size_t index = 0; index < 9; index++) {
+    unit[index] = colors_full(7);
+  }
+  unit[2] = colors_full(9);
+  unit[5] = colors_full(9);
+
+  EXPECT(hidden_subset_heuristic(cells, 9),
+         "hidden_subset_heuristic (pair) == true");
+  EXPECT((unit[2] == colors_add(colors_set(7), 8) &&
+          unit[5] == colors_add(colors_set(7), 8)),
+         "hidden_subset_heuristic (pair): cells 2 and 5 reduced to [7,8]");
+  EXPECT((unit[0] == colors_full(7)),
+         "hidden_subset_heuristic (pair): other cells left untouched");
+
+  fputs("\n", stdout);
+
   return EXIT_SUCCESS;
 }
@@ -0,0 +1,148 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <stdarg.h>
+#include <string.h>
+
+#include "../../include/colors.h"
+#include "../../include/dlx.h"
+#include "../../include/grid.h"
+
+/* gcc -I ../include -c dlx_tests.c */
+/* gcc -o dlx_tests dlx_tests.o dlx.o grid.o colors.o arena.o */
+
+void EXPECT(bool test, char *fmt, ...) {
+  fprintf(stdout, "Checking '");
+
+  va_list vargs;
+  va_start(vargs, fmt);
+  vprintf(fmt, vargs);
+  va_end(vargs);
+
+  if (test)
+    fprintf(stdout, "': (passed)\n");
+  else
+    fprintf(stdout, "': (failed!)\n");
+}
+
+/* Solutions seen by on_solution, which stops the search at 'limit' (0 for
+ * no limit) */
+typedef struct {
+  size_t found;
+  size_t limit;
+  bool valid;     /* every solution is a solved, consistent grid */
+  grid_t *first;  /* copy of the first solution */
+} collect_t;
+
+static bool on_solution(const grid_t *solution, void *data) {
+  collect_t *collect = data;
+  collect->found++;
+  grid_t *copy = grid_copy(solution);
+  collect->valid &=
+      copy != NULL && grid_is_solved(copy) && grid_is_consistent(copy);
+  if (collect->first == NULL) {
+    collect->first = copy;
+  } else {
+    grid_free(copy);
+  }
+  return collect->limit == 0 || collect->found < collect->limit;
+}
+
+/* Runs the search, without building the solutions if 'collect' is NULL */
+static size_t dlx_count(const grid_t *grid, collect_t *collect) {
+  dlx_t *dlx = dlx_alloc(grid);
+  size_t solutions = dlx_search(dlx, collect != NULL ? on_solution : NULL,
+                                collect);
+  dlx_free(dlx);
+  return solutions;
+}
+
+int main(void) {
+  /* Testing NULLs */
+  fputs("Testing NULL matrices\n"
+        "=====================\n",
+        stdout);
+
+  EXPECT((dlx_alloc(NULL) == NULL), "dlx_alloc(NULL) == NULL");
+  EXPECT((dlx_search(NULL, NULL, NULL) == 0),
+         "dlx_search(NULL, NULL, NULL) == 0");
+  EXPECT((dlx_stats(NULL).nodes == 0), "dlx_stats(NULL).nodes == 0");
+  dlx_free(NULL);
+  EXPECT((true), "dlx_free(NULL)");
+
+  fputs("\n", stdout);
+
+  /* Testing the solution counts */
+  fputs("Testing dlx_search()\n"
+        "====================\n",
+        stdout);
+
+  /* A solved 4x4 grid, then with its diagonal emptied (still unique) */
+  static const char solved[] = "1234"
+                               "3412"
+                               "2143"
+                               "4321";
+  grid_t *unique = grid_alloc(4), *empty = grid_alloc(4);
+  grid_t *none = grid_alloc(4);
+  for (size_t cell = 0; cell < 16; ++cell)
+    if (cell / 4 != cell % 4)
+      grid_set_cell(unique, cell / 4, cell % 4, solved[cell]);
+  grid_set_cell(none, 0, 0, '1');
+  grid_set_cell(none, 0, 1, '1');
+
+  collect_t collect = {0, 0, true, NULL};
+  EXPECT((dlx_count(unique, &collect) == 1 && collect.found == 1 &&
+          collect.valid),
+         "dlx_search(4x4 with a unique solution) == 1");
+  bool is_solution = collect.first != NULL;
+  for (size_t cell = 0; is_solution && cell < 16; ++cell) {
+    char *colors = grid_get_cell(collect.first, cell / 4, cell % 4);
+    is_solution = colors[0] == solved[cell] && colors[1] == '\0';
+    free(colors);
+  }
+  EXPECT((is_solution), "dlx_search(4x4 with a unique solution) solution");
+  grid_free(collect.first);
+
+  collect = (collect_t){0, 0, true, NULL};
+  EXPECT((dlx_count(empty, &collect) == 288 && collect.found == 288 &&
+          collect.valid),
+         "dlx_search(empty 4x4) == 288, all of them solved");
+  grid_free(collect.first);
+  EXPECT((dlx_count(empty, NULL) == 288),
+         "dlx_search(empty 4x4, NULL) == 288");
+
+  /* Stopped by the callback, as with --max-solutions */
+  collect = (collect_t){0, 5, true, NULL};
+  EXPECT((dlx_count(empty, &collect) == 5 && collect.found == 5),
+         "dlx_search(empty 4x4) stops after 5 solutions");
+  grid_free(collect.first);
+
+  collect = (collect_t){0, 0, true, NULL};
+  EXPECT((dlx_count(none, &collect) == 0 && collect.found == 0),
+         "dlx_search(inconsistent 4x4) == 0");
+
+  /* '1' only fits in columns 2 and 6 of rows 1, 5 and 9: no solution, though
+   * every cell keeps colors */
+  grid_t *crowded = grid_alloc(9);
+  for (size_t row = 0; row < 9; row += 4)
+    for (size_t col = 0; col < 9; ++col)
+      if (col != 1 && col != 5)
+        grid_choice_discard(crowded, (choice_t){row, col, colors_set(0)});
+  EXPECT((dlx_count(crowded, NULL) == 0),
+         "dlx_search(3 rows with 2 places for '1') == 0");
+
+  char *cell = grid_get_cell(empty, 0, 0);
+  EXPECT((strlen(cell) == 4), "dlx_alloc() leaves the grid untouched");
+  free(cell);
+
+  grid_free(unique);
+  grid_free(empty);
+  grid_free(none);
+  grid_free(crowded);
+  grid_pool_release();
+
+  return EXIT_SUCCESS;
+}
@@ -9,11 +9,13 @@
 #include <string.h>
 #include <time.h>
 
+#include "../../include/arena.h"
 #include "../../include/colors.h"
 #include "../../include/grid.h"
+#include "../../include/search.h"
 
 /* gcc -I ../include -c grid_tests.c */
-/* gcc -o grid_tests grid_tests.o grid.o colors.o */
+/* gcc -o grid_tests grid_tests.o grid.o colors.o arena.o search.o -pthread */
 
 void EXPECT(bool test, char *fmt, ...) {
   fprintf(stdout, "Checking '");
@@ -54,6 +56,24 @@ void grid_tests(size_t size) {
   /* Checking grid_check_size() */
   EXPECT((grid_check_size(size)), "grid_check_size (%zu) == true", size);
 
+  /* Checking grid_tables() */
+  const grid_tables_t *tables = grid_tables(size);
+  EXPECT((tables != NULL), "grid_tables(%zu) != NULL", size);
+  EXPECT((tables->units_nb == 3 * size), "grid_tables(%zu)->units_nb == %zu",
+         size, 3 * size);
+  EXPECT((tables->block_size * tables->block_size == size),
+         "grid_tables(%zu)->block_size == sqrt(%zu)", size, size);
+
+  bool peers_ok = true;
+  for (size_t i = 0; i < tables->peers_nb; ++i) {
+    size_t peer = grid_tables_peers(tables, 0)[i];
+    if (peer == 0 || (peer / size != 0 && peer % size != 0 &&
+                      (peer / size >= tables->block_size ||
+                       peer % size >= tables->block_size)))
+      peers_ok = false;
+  }
+  EXPECT((peers_ok), "grid_tables(%zu): peers of cell 0 share a unit", size);
+
   /* Allocation of the grid (grid_alloc()) */
   grid_t *grid = grid_alloc(size);
   EXPECT((grid), "grid_alloc(size) != NULL");
@@ -125,6 +145,48 @@ void grid_tests(size_t size) {
   EXPECT((is_equal),
          "no side effect on grid_set_cell(grid, size + 2, size / 2, '1')");
 
+  /* Checking the trail: round trips through save/restore points, with
+   * more widening writes than the initial capacity of the trail */
+  grid_t *trail = grid_alloc(size);
+  grid_set_cell(trail, 0, 0, color_table[0]);
+  EXPECT((grid_trail_save(trail) == 0),
+         "grid_trail_save(grid) == 0 while the trail is disabled");
+  EXPECT((grid_trail_enable(trail)), "grid_trail_enable(grid) == true");
+  colors_t before[size * size], middle[size * size];
+  for (size_t cell = 0; cell < size * size; ++cell)
+    before[cell] = get_grid_color(trail, cell / size, cell % size);
+
+  size_t writes = 2 * size * size * (size + 1), point = 0;
+  for (size_t write = 0; write < writes; ++write) {
+    size_t cell = random() % (size * size);
+    choice_t choice = {cell / size, cell % size,
+                       write % 2 ? colors_full(size)
+                                 : colors_set(random() % size)};
+    grid_choice_apply(trail, choice);
+    if (write == writes / 2) {
+      point = grid_trail_save(trail);
+      for (size_t cell = 0; cell < size * size; ++cell)
+        middle[cell] = get_grid_color(trail, cell / size, cell % size);
+    }
+  }
+  EXPECT((grid_trail_save(trail) == writes),
+         "grid_trail_save(grid) == %zu after %zu writes", writes, writes);
+
+  grid_trail_restore(trail, point);
+  bool is_restored = grid_trail_save(trail) == point;
+  for (size_t cell = 0; cell < size * size; ++cell)
+    if (get_grid_color(trail, cell / size, cell % size) != middle[cell])
+      is_restored = false;
+  EXPECT((is_restored), "grid_trail_restore(grid, %zu) == saved grid", point);
+
+  grid_trail_restore(trail, 0);
+  is_restored = grid_trail_save(trail) == 0;
+  for (size_t cell = 0; cell < size * size; ++cell)
+    if (get_grid_color(trail, cell / size, cell % size) != before[cell])
+      is_restored = false;
+  EXPECT((is_restored), "grid_trail_restore(grid, 0) == initial grid");
+  grid_free(trail);
+
   /* Checking grid_free() */
   grid_free(grid);
   grid_free(grid2);
@@ -147,6 +209,9 @@ int main(void) {
   EXPECT((grid_alloc(17) == NULL), "grid_alloc(17) == NULL");
   EXPECT((grid_alloc(65) == NULL), "grid_alloc(65) == NULL");
 
+  /* Checking grid_tables() */
+  EXPECT((grid_tables(17) == NULL), "grid_tables(17) == NULL");
+
   /* Checking grid_get_size() */
   EXPECT((grid_get_size(NULL) == 0), "grid_get_size(NULL) == 0");
 
@@ -169,6 +234,226 @@ int main(void) {
   grid_set_cell(NULL, 1, 1, '1');
   EXPECT((true), "grid_set_cell(NULL, 1, 1, '1')");
 
+  /* Checking grid_pipeline_set() */
+  heuristic_t no_singles[] = {heuristic_locked, heuristic_subsets};
+  heuristic_t twice[] = {heuristic_singles, heuristic_locked,
+                         heuristic_locked};
+  heuristic_t pipeline[] = {heuristic_singles, heuristic_subsets};
+  heuristic_t stages[GRID_HEURISTICS_NB];
+  EXPECT((!grid_pipeline_set(NULL, 2, false)),
+         "grid_pipeline_set(NULL, 2, false) == false");
+  EXPECT((!grid_pipeline_set(no_singles, 2, false)),
+         "grid_pipeline_set([locked, subsets], 2, false) == false");
+  EXPECT((!grid_pipeline_set(twice, 3, false)),
+         "grid_pipeline_set([singles, locked, locked], 3, false) == false");
+  EXPECT((grid_pipeline_set(pipeline, 2, true) &&
+          grid_pipeline_get(stages) == 2 &&
+          stages[1] == heuristic_subsets && grid_pipeline_is_adaptive()),
+         "grid_pipeline_set([singles, subsets], 2, true) == true");
+  EXPECT((grid_heuristic_name(GRID_HEURISTICS_NB) == NULL),
+         "grid_heuristic_name(GRID_HEURISTICS_NB) == NULL");
+
+  heuristic_t defaults[] = {heuristic_singles, heuristic_locked,
+                            heuristic_subsets, heuristic_fish};
+  grid_pipeline_set(defaults, GRID_HEURISTICS_NB, false);
+
+  fputs("\n", stdout);
+
+  /* Testing the bounded searches */
+  fputs("Testing search_count() and search_unique()\n"
+        "==========================================\n",
+        stdout);
+
+  /* A solved 4x4 grid, then with its diagonal emptied (still unique) */
+  static const char solved[] = "1234"
+                               "3412"
+                               "2143"
+                               "4321";
+  grid_t *unique = grid_alloc(4), *empty = grid_alloc(4);
+  grid_t *none = grid_alloc(4), *solution = empty;
+  for (size_t cell = 0; cell < 16; ++cell)
+    if (cell / 4 != cell % 4)
+      grid_set_cell(unique, cell / 4, cell % 4, solved[cell]);
+  grid_set_cell(none, 0, 0, '1');
+  grid_set_cell(none, 0, 1, '1');
+  search_stats_t stats = {0, 0, 0, 0};
+
+  EXPECT((search_unique(unique, 1, &solution, &stats) == solutions_unique &&
+          solution != NULL && stats.nodes > 0),
+         "search_unique(4x4 with a unique solution) == solutions_unique");
+  bool is_solution = solution != NULL;
+  for (size_t cell = 0; is_solution && cell < 16; ++cell) {
+    char *colors = grid_get_cell(solution, cell / 4, cell % 4);
+    is_solution = colors[0] == solved[cell] && colors[1] == '\0';
+    free(colors);
+  }
+  EXPECT((is_solution), "search_unique(4x4 with a unique solution) solution");
+  grid_free(solution);
+
+  solution = empty;
+  EXPECT((search_unique(empty, 2, &solution, NULL) == solutions_many &&
+          solution == NULL),
+         "search_unique(empty 4x4) == solutions_many, no solution");
+  solution = empty;
+  EXPECT((search_unique(none, 1, &solution, NULL) == solutions_none &&
+          solution == NULL),
+         "search_unique(inconsistent 4x4) == solutions_none, no solution");
+  EXPECT((search_unique(unique, 1, NULL, NULL) == solutions_unique),
+         "search_unique(4x4 with a unique solution, NULL) == solutions_unique");
+
+  EXPECT((search_count(empty, 1, 1000, NULL) == 288),
+         "search_count(empty 4x4, 1000) == 288");
+  size_t grid_bytes = alloc_stats_get().grid_bytes;
+  EXPECT((search_count(empty, 4, 1000, NULL) == 288),
+         "search_count(empty 4x4, 1000) == 288 on 4 threads");
+  EXPECT((alloc_stats_get().grid_bytes == grid_bytes &&
+          alloc_stats_get().grid_peak > grid_bytes),
+         "search_count() on 4 threads gives back the grid memory it counts");
+  EXPECT((search_count(empty, 1, 5, NULL) == 5),
+         "search_count(empty 4x4, 5) == 5");
+  EXPECT((search_count(empty, 1, 0, NULL) == 0),
+         "search_count(empty 4x4, 0) == 0");
+  EXPECT((search_count(none, 1, 2, NULL) == 0),
+         "search_count(inconsistent 4x4, 2) == 0");
+  EXPECT((search_count(NULL, 1, 2, NULL) == 0), "search_count(NULL, 2) == 0");
+
+  char *cell = grid_get_cell(empty, 0, 0);
+  EXPECT((strlen(cell) == 4), "search_count() leaves the grid untouched");
+  free(cell);
+  grid_free(unique);
+  grid_free(empty);
+  grid_free(none);
+  search_release();
+
+  /* Testing the tie-break of grid_choice() */
+  fputs("\nTesting grid_choice_tie_break()\n"
+        "===============================\n",
+        stdout);
+
+  /* With the first row solved, the cells of the second row have the fewest
+   * unsolved cells in their units, those of the last two rows the most */
+  grid_t *ties = grid_alloc(4);
+  for (size_t col = 0; col < 4; ++col)
+    grid_set_cell(ties, 0, col, solved[col]);
+  EXPECT((grid_choice(ties).row == 1),
+         "grid_choice(first row solved).row == 1 (fewest unsolved)");
+  grid_choice_tie_break(tie_most_unsolved);
+  EXPECT((grid_choice(ties).row >= 2),
+         "grid_choice(first row solved).row >= 2 (most unsolved)");
+  grid_choice_tie_break(tie_fewest_unsolved);
+  grid_free(ties);
+
+  /* The only cell with three colors is the bottom right one. '2' is fixed
+   * twice around it, out of its peers, '3' once, in one of its peers */
+  grid_t *values = grid_alloc(4);
+  choice_t four = {3, 3, colors_set(3)};
+  grid_choice_discard(values, four);
+  grid_set_cell(values, 0, 3, '3');
+  grid_set_cell(values, 1, 2, '2');
+  grid_set_cell(values, 2, 0, '2');
+  EXPECT((grid_choice_ordered(values, value_lowest, NULL).color ==
+          colors_set(0)),
+         "grid_choice_ordered(value_lowest).color == '1'");
+  EXPECT((grid_choice_ordered(values, value_most_frequent, NULL).color ==
+          colors_set(1)),
+         "grid_choice_ordered(value_most_frequent).color == '2'");
+  grid_free(values);
+
+  /* Testing locked candidates */
+  fputs("\nTesting the locked stage\n"
+        "========================\n",
+        stdout);
+
+  heuristic_t locking[] = {heuristic_singles, heuristic_locked};
+  grid_pipeline_set(locking, 2, false);
+
+  /* Pointing: '1' only fits in the first row of the first block, so the
+   * rest of the row loses it */
+  grid_t *pointing = grid_alloc(9);
+  for (size_t row = 1; row < 3; ++row)
+    for (size_t col = 0; col < 3; ++col)
+      grid_choice_discard(pointing, (choice_t){row, col, colors_set(0)});
+  EXPECT((grid_heuristics(pointing) == grid_unsolved),
+         "grid_heuristics(pointing) == grid_unsolved");
+  bool pointed = true;
+  for (size_t col = 3; col < 9; ++col)
+    pointed &= !colors_is_in(get_grid_color(pointing, 0, col), 0);
+  EXPECT((pointed), "grid_heuristics(pointing) removes '1' from row 1");
+  EXPECT((colors_is_in(get_grid_color(pointing, 0, 2), 0) &&
+          colors_is_in(get_grid_color(pointing, 1, 3), 0)),
+         "grid_heuristics(pointing) keeps '1' in the block and other rows");
+  grid_free(pointing);
+
+  /* Claiming: '2' only fits in the central block in row 5, so the rest of
+   * the block loses it */
+  grid_t *claiming = grid_alloc(9);
+  for (size_t col = 0; col < 9; ++col)
+    if (col < 3 || col > 5)
+      grid_choice_discard(claiming, (choice_t){4, col, colors_set(1)});
+  EXPECT((grid_heuristics(claiming) == grid_unsolved),
+         "grid_heuristics(claiming) == grid_unsolved");
+  bool claimed = true;
+  for (size_t row = 3; row < 6; ++row)
+    for (size_t col = 3; col < 6; ++col)
+      if (row != 4)
+        claimed &= !colors_is_in(get_grid_color(claiming, row, col), 1);
+  EXPECT((claimed), "grid_heuristics(claiming) removes '2' from block 5");
+  EXPECT((colors_is_in(get_grid_color(claiming, 4, 3), 1) &&
+          colors_is_in(get_grid_color(claiming, 3, 0), 1)),
+         "grid_heuristics(claiming) keeps '2' in row 5 and other blocks");
+  grid_free(claiming);
+
+  /* Testing the fish stage */
+  fputs("\nTesting the fish stage\n"
+        "======================\n",
+        stdout);
+
+  /* '1' only fits in columns 2 and 6 of rows 1 and 5: an x-wing that
+   * removes it from the other cells of these columns */
+  heuristic_t fishing[] = {heuristic_singles, heuristic_fish};
+  grid_pipeline_set(fishing, 2, false);
+  grid_fish_enable(2);
+  grid_fish_stats_reset();
+  grid_t *xwing = grid_alloc(9);
+  for (size_t row = 0; row <= 4; row += 4)
+    for (size_t col = 0; col < 9; ++col)
+      if (col != 1 && col != 5)
+        grid_choice_discard(xwing, (choice_t){row, col, colors_set(0)});
+  EXPECT((grid_heuristics(xwing) == grid_unsolved),
+         "grid_heuristics(x-wing) == grid_unsolved");
+  bool xwing_removed = true;
+  for (size_t row = 0; row < 9; ++row)
+    if (row != 0 && row != 4)
+      xwing_removed &= !colors_is_in(get_grid_color(xwing, row, 1), 0) &&
+                       !colors_is_in(get_grid_color(xwing, row, 5), 0);
+  EXPECT((xwing_removed),
+         "grid_heuristics(x-wing) removes '1' from columns 2 and 6");
+  EXPECT((colors_is_in(get_grid_color(xwing, 0, 1), 0) &&
+          colors_is_in(get_grid_color(xwing, 4, 5), 0) &&
+          colors_is_in(get_grid_color(xwing, 2, 2), 0)),
+         "grid_heuristics(x-wing) keeps '1' in the x-wing and elsewhere");
+  EXPECT((grid_fish_stats().found[2] == 1 &&
+          grid_fish_stats().eliminations == 14),
+         "grid_fish_stats() counts one x-wing and 14 eliminations");
+  grid_free(xwing);
+
+  /* Then in row 9 as well: three lines, two places */
+  grid_t *crowded = grid_alloc(9);
+  for (size_t row = 0; row < 9; row += 4)
+    for (size_t col = 0; col < 9; ++col)
+      if (col != 1 && col != 5)
+        grid_choice_discard(crowded, (choice_t){row, col, colors_set(0)});
+  grid_t *unfished = grid_copy(crowded);
+  grid_fish_enable(3);
+  EXPECT((grid_heuristics(crowded) == grid_inconsistent),
+         "grid_heuristics(3 rows, 2 places) == grid_inconsistent");
+  grid_fish_enable(0);
+  EXPECT((grid_heuristics(unfished) == grid_unsolved),
+         "grid_heuristics(3 rows, 2 places) == grid_unsolved with no fish");
+  grid_free(crowded);
+  grid_free(unfished);
+  grid_pipeline_set(defaults, GRID_HEURISTICS_NB, false);
+
   fputs("\n", stdout);
 
   /* Positive tests on valid grid sizes */